@@ -0,0 +1,77 @@
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "input_source.h"
+#include "bit_reader.h"
+#include "video.h"
+/* times the two ways of decoding ac coefficients, one code per lookup
+ * and up to three per lookup in ht_coef_multi. Each stream is read into
+ * memory and decoded several times each way with the frames thrown
+ * away; the best time of each way is reported. A checked pass first
+ * makes sure both give the same pictures. */
+
+/* hashes the visible luma into sum, if given */
+class CheckSink : public FrameSink {
+public:
+    uint64_t *sum;
+    CheckSink(uint64_t *__sum): sum(__sum) {}
+    void frame(YCbCrBuffer *buf) {
+        if(!sum) return;
+        for(int y=0; y<buf->v_size; ++y)
+            for(int x=0; x<buf->h_size; ++x)
+                *sum = *sum*31 + buf->y[y*buf->y_stride + x];
+    }
+};
+
+static double decode(const std::vector<byte> &data, bool multi, uint64_t *sum) {
+    MemorySource input(data.data(), data.size());
+    BitReader stream(input);
+    CheckSink sink(sum);
+    VideoDecoder decoder(sink);
+    decoder.coef_multi = multi;
+    auto start = std::chrono::steady_clock::now();
+    decoder.video_sequence(stream);
+    std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+    return took.count();
+}
+
+int main(int argc, char *argv[]) {
+    const int runs = 15;
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s file...\n", argv[0]);
+        return 1;
+    }
+    // the decoder logs every picture and slice to stdout
+    if(!freopen("/dev/null", "w", stdout))
+        return 1;
+    bool same = true;
+    for(int f=1; f<argc; ++f) {
+        FILE *file = fopen(argv[f], "rb");
+        if(!file) {
+            perror(argv[f]);
+            return 1;
+        }
+        std::vector<byte> data;
+        byte buf[1<<16];
+        size_t n;
+        while((n = fread(buf, 1, sizeof(buf), file)) > 0)
+            data.insert(data.end(), buf, buf+n);
+        fclose(file);
+
+        uint64_t sum_single = 0, sum_multi = 0;
+        decode(data, false, &sum_single);
+        decode(data, true, &sum_multi);
+        double single = 1e9, multi = 1e9;
+        for(int r=0; r<runs; ++r) {
+            single = std::min(single, decode(data, false, nullptr));
+            multi = std::min(multi, decode(data, true, nullptr));
+        }
+        fprintf(stderr, "%s: %zu bytes, single %.4f s, multi %.4f s (%+.1f%%)%s\n",
+            argv[f], data.size(), single, multi, 100*(multi-single)/single,
+            sum_single == sum_multi ? "" : ", pictures differ");
+        same &= sum_single == sum_multi;
+    }
+    return same ? 0 : 1;
+}
@@ -1,27 +1,55 @@
 #include <cassert>
 #include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "bit_reader.h"
 
-BitReader::BitReader(FILE *__file): file(__file) {
-    now = prev = 0;
-    mask = prev_mask = 0;
+BitReader::BitReader(InputSource &__source): source(__source) {
+    begin = ptr = end = nullptr;
+    chunk_offset = 0;
+    cache = 0;
+    bits = pad = 0;
 }
 
-byte BitReader::read() {
-    byte res;
-    if(mask == 0) {
-        fread(&now, 1, 1, file); mask = 0x80;
+/* load one 64-bit big-endian word */
+static inline uint64_t load_be64(const byte *p) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return __builtin_bswap64(w);
+}
+
+/* top up the cache to at least 57 bits, zero padding past the end */
+void BitReader::fill() {
+    if(end-ptr >= 8) {
+        // bits below the accounted bytes are rewritten identically later
+        cache |= load_be64(ptr) >> bits;
+        int nbytes = (64-bits) >> 3;
+        ptr += nbytes;
+        bits += nbytes << 3;
+        return;
+    }
+    while(bits <= 56) {
+        if(ptr == end and !next_chunk()) {
+            // whole zero bytes, keeping bits&7 as the byte alignment
+            int nbytes = (64-bits) >> 3;
+            pad += nbytes << 3;
+            bits += nbytes << 3;
+            return;
+        }
+        cache |= (uint64_t)*ptr++ << (56-bits);
+        bits += 8;
     }
-    res = (now&mask)!=0;
-    mask >>= 1;
-    return res;
 }
 
-int BitReader::read(int nbits) {
-    int res = 0;
-    for(int i=0; i<nbits; ++i)
-        res = (res<<1)+read();
-    return res;
+bool BitReader::next_chunk() {
+    const byte *data;
+    size_t size = source.next_chunk(data);
+    if(size == 0) return false;
+    chunk_offset += end-begin;
+    begin = ptr = data;
+    end = data + size;
+    return true;
 }
 
 void BitReader::read(byte *buf, size_t size) {
@@ -29,65 +57,60 @@ void BitReader::read(byte *buf, size_t size) {
         buf[i] = read(8);
 }
 
-bool BitReader::next_bits(const char *const bits, bool keep) {
-    if(keep) save();
-
-    bool res = true;
-    for(int i=0; bits[i] and res; ++i) {
-        byte bit = read();
-        assert(bits[i]=='0' || bits[i]=='1');
-        if(bit != (bits[i]-'0'))
-            res = false;
+/* first 00 00 01 in [p, end); when there is none, returns the last
+ * (at most two) bytes, where a start code crossing end could begin */
+static const byte *find_start_code(const byte *p, const byte *end) {
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    for(; end-p >= 18; p += 16) {
+        __m128i b0 = _mm_loadu_si128((const __m128i*)p);
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(p+1));
+        __m128i b2 = _mm_loadu_si128((const __m128i*)(p+2));
+        __m128i hit = _mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+            _mm_cmpeq_epi8(b2, one));
+        int mask = _mm_movemask_epi8(hit);
+        if(mask) return p + __builtin_ctz(mask);
     }
-
-    if(keep) restore();
-    return res;
+#else
+    while(end-p >= 3) {
+        const byte *q = (const byte*)memchr(p+2, 0x01, end-p-2);
+        if(q == nullptr) {
+            p = end-2;
+            break;
+        }
+        if(q[-1] == 0 and q[-2] == 0) return q-2;
+        p = q+1;
+    }
+#endif
+    for(; end-p >= 3; ++p)
+        if(p[0] == 0 and p[1] == 0 and p[2] == 1) return p;
+    return p;
 }
 
 void BitReader::next_start_code() {
-    while(mask != 0)
-        /*assert*/(next_bits("0", false));
-    while(!next_bits(start_code))
-        /*assert*/(next_bits("00000000", false));
-}
-
-void BitReader::save() {
-    prev = now;
-    prev_mask = mask;
-    fgetpos(file, &prev_pos);
-}
-
-void BitReader::restore() {
-    now = prev;
-    mask = prev_mask;
-    fsetpos(file, &prev_pos);
-}
-
-void HuffmanTree::insertNode(const char *const path, int val) {
-    Node *ptr = root;
-    for(int i=0; path[i]; ++i) {
-        int bit = path[i]-'0';
-        if(ptr->child[bit] == nullptr) {
-            Node *newNode = new Node();
-            ptr->child[bit] = newNode;
+    skip(bits & 7); // align byte
+    while(true) {
+        if(pad == 0 and ptr-begin >= (bits>>3)) {
+            // every cached byte is still in the chunk, scan it in place
+            ptr -= bits>>3;
+            cache = 0;
+            bits = 0;
+            ptr = find_start_code(ptr, end);
+            if(end-ptr >= 3) return;
         }
-        ptr = ptr->child[bit];
+        // bytes around a chunk boundary
+        if(peek(24) == start_code or eof()) return;
+        skip(8);
     }
-    ptr->val = val;
-    ptr->leaf = true;
-    return;
 }
 
-HuffmanTree::HuffmanTree() {
-    root = new Node();
+bool BitReader::eof() const {
+    return pad > 0 and bits <= pad;
 }
 
-int HuffmanTree::decode(BitReader &bitReader) {
-    Node *now = root;
-    while(now and !now->leaf) {
-        int tmp = bitReader.read();
-        now = now->child[tmp];
-    }
-    assert(now);
-    return now->val;
+/* stream offset of the byte holding the next bit, exact when aligned */
+uint64_t BitReader::tell() const {
+    return chunk_offset + (ptr-begin) - ((bits-pad) >> 3);
 }
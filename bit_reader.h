@@ -1,41 +1,102 @@
 #ifndef _BIT_READER_H_
 #define _BIT_READER_H_
-#include <cstdio>
+#include <cassert>
+#include <cstdint>
 #include "magic_code.h"
+#include "input_source.h"
 class BitReader {
 private:
-    FILE *const file;
-    byte now;
-    byte mask;
+    InputSource &source;
+    const byte *begin, *ptr, *end; // current chunk
+    uint64_t chunk_offset; // stream offset of begin
 
-    fpos_t prev_pos;
-    byte prev;
-    byte prev_mask;
+    /* upcoming bits, msb first */
+    uint64_t cache;
+    int bits; // valid bits in cache
+    int pad;  // zero bits appended past the end of input
+
+    void fill();
+    bool next_chunk();
 public:
-    BitReader(FILE *__file);
-    byte read();
+    BitReader(InputSource &__source);
+    uint32_t peek(int nbits);
+    void skip(int nbits);
     int read(int nbits);
+    byte read();
     void read(byte *buf, size_t size);
-    bool next_bits(const char *const bits, bool keep=true);
     void next_start_code();
-    void save();
-    void restore();
+    bool eof() const;
+    uint64_t tell() const;
 };
 
-class HuffmanTree {
+/* nbits must be in [1, 32] */
+inline uint32_t BitReader::peek(int nbits) {
+    if(bits < nbits) fill();
+    return cache >> (64-nbits);
+}
+
+inline void BitReader::skip(int nbits) {
+    if(bits < nbits) fill();
+    cache <<= nbits;
+    bits -= nbits;
+}
+
+inline int BitReader::read(int nbits) {
+    int res = peek(nbits);
+    skip(nbits);
+    return res;
+}
+
+inline byte BitReader::read() {
+    return read(1);
+}
+
+/* two-level lookup table for variable length codes: the first
+ * root_bits index the root table, longer codes continue through a link
+ * into a subtable indexed by the following sub_bits. Tables are
+ * generated at build time by gen_vlc_tables. */
+class VLCTable {
+public:
+    struct Entry {
+        int16_t val;  // symbol, or subtable offset for links
+        byte len;     // bits to consume, 0 for links
+        byte sub_bits;
+    };
 private:
-    struct Node {
-        int val;
-        bool leaf;
-        Node *child[2];
-        Node () {
-            child[0] = child[1] = nullptr;
-            leaf = false;
-        }
-    } *root;
+    const Entry *const table;
+    const int root_bits;
 public:
-    HuffmanTree();
-    void insertNode(const char *const path, int val);
-    int decode(BitReader &bitReader);
+    constexpr VLCTable(const Entry *__table, int __root_bits):
+        table(__table), root_bits(__root_bits) {}
+    int decode(BitReader &stream) const;
+};
+
+/* special symbols of the run/level tables, whose other symbols are
+ * packed as run<<8 | (level & 0xFF) */
+const int coef_eob = 0x4000;
+const int coef_escape = 0x4100;
+
+/* multi-symbol lookup for the ac coefficients: one peek of
+ * coef_multi_bits yields up to three short run/level codes and their
+ * total length, eob is set if the last code read ended the block.
+ * len 0 means the next code is long or an escape and goes through the
+ * single-symbol table. */
+const int coef_multi_bits = 12;
+struct RunLevelEntry {
+    byte n, len, eob;
+    byte run[3];
+    int8_t level[3];
 };
+
+inline int VLCTable::decode(BitReader &stream) const {
+    const Entry *e = &table[stream.peek(root_bits)];
+    if(e->len == 0) {
+        assert(e->sub_bits != 0); // invalid code
+        stream.skip(root_bits);
+        e = &table[e->val + stream.peek(e->sub_bits)];
+    }
+    assert(e->len != 0);
+    stream.skip(e->len);
+    return e->val;
+}
 #endif
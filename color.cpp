@@ -0,0 +1,246 @@
+#include <algorithm>
+#include "color.h"
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* 255/219, and 255/112 times the BT.601 chroma weights */
+static const int coef_y = 9539;
+static const int coef_r_cr = 13075;
+static const int coef_g_cb = -3209;
+static const int coef_g_cr = -6660;
+static const int coef_b_cb = 16525;
+static const int round_bits = 13;
+
+static inline byte clip(int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static void chroma_nearest_scalar(byte *dst, const byte *src, int width) {
+    for(int x=0; x<width; ++x)
+        dst[x] = src[x>>1];
+}
+
+/* vertical sums into sums[1..cw], edges replicated into sums[0] and
+ * sums[cw+1]; the sse2 version shares it */
+static inline void chroma_sums(int16_t *sums, const byte *near, const byte *far, int from, int cw) {
+    for(int i=from; i<cw; ++i)
+        sums[i+1] = 3*near[i] + far[i];
+    sums[0] = sums[1];
+    sums[cw+1] = sums[cw];
+}
+
+static inline void chroma_columns(byte *dst, const int16_t *sums, int from, int width) {
+    for(int x=from; x<width; ++x) {
+        int i = (x>>1) + 1;
+        int side = x&1 ? sums[i+1] : sums[i-1];
+        dst[x] = (3*sums[i] + side + 8) >> 4;
+    }
+}
+
+static void chroma_bilinear_scalar(byte *dst, int16_t *sums,
+        const byte *near, const byte *far, int width) {
+    chroma_sums(sums, near, far, 0, (width+1)/2);
+    chroma_columns(dst, sums, 0, width);
+}
+
+static inline void rgb_pixel(byte *r, byte *g, byte *b, int y, int cb, int cr) {
+    const int half = 1 << (round_bits-1);
+    y = coef_y*(y-16) + half;
+    cb -= 128, cr -= 128;
+    *r = clip((y + coef_r_cr*cr) >> round_bits);
+    *g = clip((y + coef_g_cb*cb + coef_g_cr*cr) >> round_bits);
+    *b = clip((y + coef_b_cb*cb) >> round_bits);
+}
+
+static void rgb_row_scalar(byte *r, byte *g, byte *b,
+        const byte *y, const byte *cb, const byte *cr, int width) {
+    for(int x=0; x<width; ++x)
+        rgb_pixel(r+x, g+x, b+x, y[x], cb[x], cr[x]);
+}
+
+const ColorKernels color_scalar = {
+    chroma_nearest_scalar, chroma_bilinear_scalar, rgb_row_scalar
+};
+
+#ifdef HAVE_X86_SIMD
+/* pmaddwd pairs each luma sample with a chroma sample, or a chroma
+ * sample with the rounding constant, so every channel is one or two
+ * multiply-adds in 32 bits; results are packed back with saturation,
+ * which clips to [0, 255] */
+
+/* lo in the low 16 bits of each 32, hi in the high ones */
+static inline int coef_pair(int lo, int hi) {
+    return (int)((unsigned)(hi & 0xFFFF) << 16 | (lo & 0xFFFF));
+}
+
+SSE2 static void chroma_nearest_sse2(byte *dst, const byte *src, int width) {
+    int x = 0;
+    for(; x+32<=width; x+=32) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src+x/2));
+        _mm_storeu_si128((__m128i*)(dst+x), _mm_unpacklo_epi8(v, v));
+        _mm_storeu_si128((__m128i*)(dst+x+16), _mm_unpackhi_epi8(v, v));
+    }
+    for(; x<width; ++x)
+        dst[x] = src[x>>1];
+}
+
+SSE2 static void chroma_bilinear_sse2(byte *dst, int16_t *sums,
+        const byte *near, const byte *far, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    int cw = (width+1)/2, i = 0;
+    for(; i+8<=cw; i+=8) {
+        __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(near+i)), zero);
+        __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(far+i)), zero);
+        a = _mm_add_epi16(_mm_add_epi16(a, _mm_add_epi16(a, a)), b);
+        _mm_storeu_si128((__m128i*)(sums+i+1), a);
+    }
+    chroma_sums(sums, near, far, i, cw);
+
+    // 16 outputs from sums[i..i+9]: even ones lean left, odd ones right
+    const __m128i eight = _mm_set1_epi16(8);
+    int x = 0;
+    for(; x+16<=width; x+=16) {
+        const int16_t *s = sums + x/2;
+        __m128i left = _mm_loadu_si128((const __m128i*)s);
+        __m128i mid = _mm_loadu_si128((const __m128i*)(s+1));
+        __m128i right = _mm_loadu_si128((const __m128i*)(s+2));
+        mid = _mm_add_epi16(_mm_add_epi16(mid, _mm_add_epi16(mid, mid)), eight);
+        __m128i even = _mm_srli_epi16(_mm_add_epi16(mid, left), 4);
+        __m128i odd = _mm_srli_epi16(_mm_add_epi16(mid, right), 4);
+        __m128i lo = _mm_unpacklo_epi16(even, odd);
+        __m128i hi = _mm_unpackhi_epi16(even, odd);
+        _mm_storeu_si128((__m128i*)(dst+x), _mm_packus_epi16(lo, hi));
+    }
+    chroma_columns(dst, sums, x, width);
+}
+
+/* y, cb and cr hold 16-bit samples with the offsets taken off; the two
+ * halves of each pair are 4 pixels, low and high */
+SSE2 static inline __m128i channel_sse2(__m128i a, __m128i b, __m128i coef) {
+    return _mm_madd_epi16(_mm_unpacklo_epi16(a, b), coef);
+}
+
+SSE2 static inline __m128i pack_channel_sse2(__m128i lo, __m128i hi) {
+    return _mm_packs_epi32(_mm_srai_epi32(lo, round_bits), _mm_srai_epi32(hi, round_bits));
+}
+
+SSE2 static void rgb_row_sse2(byte *r, byte *g, byte *b,
+        const byte *y, const byte *cb, const byte *cr, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i sixteen = _mm_set1_epi16(16), center = _mm_set1_epi16(128);
+    const __m128i half = _mm_set1_epi16(1 << (round_bits-1));
+    const __m128i r_coef = _mm_set1_epi32(coef_pair(coef_y, coef_r_cr));
+    const __m128i g_coef = _mm_set1_epi32(coef_pair(coef_y, coef_g_cb));
+    const __m128i g_cr_coef = _mm_set1_epi32(coef_pair(coef_g_cr, 1));
+    const __m128i b_coef = _mm_set1_epi32(coef_pair(coef_y, coef_b_cb));
+    int x = 0;
+    for(; x+8<=width; x+=8) {
+        __m128i vy = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(y+x)), zero), sixteen);
+        __m128i vb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(cb+x)), zero), center);
+        __m128i vr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(cr+x)), zero), center);
+        __m128i y_hi = _mm_unpackhi_epi64(vy, vy);
+        __m128i b_hi = _mm_unpackhi_epi64(vb, vb);
+        __m128i r_hi = _mm_unpackhi_epi64(vr, vr);
+        // the cr term of green carries the rounding constant
+        __m128i g_lo = _mm_add_epi32(channel_sse2(vy, vb, g_coef), channel_sse2(vr, half, g_cr_coef));
+        __m128i g_hi = _mm_add_epi32(channel_sse2(y_hi, b_hi, g_coef), channel_sse2(r_hi, half, g_cr_coef));
+        __m128i rnd = _mm_unpacklo_epi16(half, zero);
+        __m128i out_r = pack_channel_sse2(
+            _mm_add_epi32(channel_sse2(vy, vr, r_coef), rnd),
+            _mm_add_epi32(channel_sse2(y_hi, r_hi, r_coef), rnd));
+        __m128i out_g = pack_channel_sse2(g_lo, g_hi);
+        __m128i out_b = pack_channel_sse2(
+            _mm_add_epi32(channel_sse2(vy, vb, b_coef), rnd),
+            _mm_add_epi32(channel_sse2(y_hi, b_hi, b_coef), rnd));
+        _mm_storel_epi64((__m128i*)(r+x), _mm_packus_epi16(out_r, out_r));
+        _mm_storel_epi64((__m128i*)(g+x), _mm_packus_epi16(out_g, out_g));
+        _mm_storel_epi64((__m128i*)(b+x), _mm_packus_epi16(out_b, out_b));
+    }
+    rgb_row_scalar(r+x, g+x, b+x, y+x, cb+x, cr+x, width-x);
+}
+
+const ColorKernels color_sse2 = {
+    chroma_nearest_sse2, chroma_bilinear_sse2, rgb_row_sse2
+};
+
+/* avx2 converts 16 pixels at a time; unpacking and packing both work
+ * within 128-bit lanes, so pixel order only needs fixing at the end.
+ * Upsampling is cheap next to this and stays on sse2. */
+AVX2 static inline __m256i load_samples_avx2(const byte *p, __m256i offset) {
+    __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)p));
+    return _mm256_sub_epi16(v, offset);
+}
+
+AVX2 static inline void store_channel_avx2(byte *p, __m256i lo, __m256i hi) {
+    __m256i v = _mm256_packs_epi32(_mm256_srai_epi32(lo, round_bits), _mm256_srai_epi32(hi, round_bits));
+    v = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08);
+    _mm_storeu_si128((__m128i*)p, _mm256_castsi256_si128(v));
+}
+
+AVX2 static void rgb_row_avx2(byte *r, byte *g, byte *b,
+        const byte *y, const byte *cb, const byte *cr, int width) {
+    const __m256i sixteen = _mm256_set1_epi16(16), center = _mm256_set1_epi16(128);
+    const __m256i half = _mm256_set1_epi16(1 << (round_bits-1));
+    const __m256i rnd = _mm256_set1_epi32(1 << (round_bits-1));
+    const __m256i r_coef = _mm256_set1_epi32(coef_pair(coef_y, coef_r_cr));
+    const __m256i g_coef = _mm256_set1_epi32(coef_pair(coef_y, coef_g_cb));
+    const __m256i g_cr_coef = _mm256_set1_epi32(coef_pair(coef_g_cr, 1));
+    const __m256i b_coef = _mm256_set1_epi32(coef_pair(coef_y, coef_b_cb));
+    int x = 0;
+    for(; x+16<=width; x+=16) {
+        __m256i vy = load_samples_avx2(y+x, sixteen);
+        __m256i vb = load_samples_avx2(cb+x, center);
+        __m256i vr = load_samples_avx2(cr+x, center);
+        __m256i yr_lo = _mm256_unpacklo_epi16(vy, vr), yr_hi = _mm256_unpackhi_epi16(vy, vr);
+        __m256i yb_lo = _mm256_unpacklo_epi16(vy, vb), yb_hi = _mm256_unpackhi_epi16(vy, vb);
+        __m256i rh_lo = _mm256_unpacklo_epi16(vr, half), rh_hi = _mm256_unpackhi_epi16(vr, half);
+        store_channel_avx2(r+x,
+            _mm256_add_epi32(_mm256_madd_epi16(yr_lo, r_coef), rnd),
+            _mm256_add_epi32(_mm256_madd_epi16(yr_hi, r_coef), rnd));
+        store_channel_avx2(g+x,
+            _mm256_add_epi32(_mm256_madd_epi16(yb_lo, g_coef), _mm256_madd_epi16(rh_lo, g_cr_coef)),
+            _mm256_add_epi32(_mm256_madd_epi16(yb_hi, g_coef), _mm256_madd_epi16(rh_hi, g_cr_coef)));
+        store_channel_avx2(b+x,
+            _mm256_add_epi32(_mm256_madd_epi16(yb_lo, b_coef), rnd),
+            _mm256_add_epi32(_mm256_madd_epi16(yb_hi, b_coef), rnd));
+    }
+    rgb_row_sse2(r+x, g+x, b+x, y+x, cb+x, cr+x, width-x);
+}
+
+const ColorKernels color_avx2 = {
+    chroma_nearest_sse2, chroma_bilinear_sse2, rgb_row_avx2
+};
+#endif
+
+const ColorKernels *const color = CPU_SELECT(&color_scalar, &color_sse2, &color_avx2);
+
+ColorConverter::ColorConverter(ChromaFilter __filter): filter(__filter) {
+}
+
+void ColorConverter::convert(const YCbCrBuffer *frame, byte *rgb) {
+    int width = frame->h_size, height = frame->v_size;
+    int c_height = (height+1)/2;
+    cb_row.resize(width);
+    cr_row.resize(width);
+    sums.resize((width+1)/2 + 2);
+    byte *r = rgb, *g = rgb + width*height, *b = rgb + 2*width*height;
+    for(int j=0; j<height; ++j, r+=width, g+=width, b+=width) {
+        const byte *y = frame->y + j*frame->y_stride;
+        int near = j>>1;
+        const byte *cb = frame->cb + near*frame->c_stride;
+        const byte *cr = frame->cr + near*frame->c_stride;
+        if(filter == chroma_nearest) {
+            color->chroma_nearest(cb_row.data(), cb, width);
+            color->chroma_nearest(cr_row.data(), cr, width);
+        }
+        else {
+            // even rows lean on the row above, odd ones on the row below
+            int far = j&1 ? std::min(near+1, c_height-1) : std::max(near-1, 0);
+            int offset = (far-near)*frame->c_stride;
+            color->chroma_bilinear(cb_row.data(), sums.data(), cb, cb + offset, width);
+            color->chroma_bilinear(cr_row.data(), sums.data(), cr, cr + offset, width);
+        }
+        color->rgb_row(r, g, b, y, cb_row.data(), cr_row.data(), width);
+    }
+}
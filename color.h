@@ -0,0 +1,46 @@
+#ifndef _COLOR_H_
+#define _COLOR_H_
+#include <cstdint>
+#include <vector>
+#include "magic_code.h"
+#include "cpu.h"
+#include "frame_pool.h"
+/* colour conversion kernels, one row at a time. Samples are studio
+ * range BT.601, rgb comes out full range; coefficients are fixed point
+ * with 13 fractional bits, so every kernel gives the same result.
+ * Chroma is upsampled to a full row first: nearest repeats each sample,
+ * bilinear weighs the two nearest rows and columns 3:1, as chroma sits
+ * halfway between luma samples. */
+struct ColorKernels {
+    /* dst[x] = src[x/2] */
+    void (*chroma_nearest)(byte *dst, const byte *src, int width);
+    /* near is the closer chroma row, far the other one; sums holds
+     * (width+1)/2 + 2 entries */
+    void (*chroma_bilinear)(byte *dst, int16_t *sums,
+        const byte *near, const byte *far, int width);
+    void (*rgb_row)(byte *r, byte *g, byte *b,
+        const byte *y, const byte *cb, const byte *cr, int width);
+};
+extern const ColorKernels *const color; // see cpu.h
+
+extern const ColorKernels color_scalar;
+#ifdef HAVE_X86_SIMD
+extern const ColorKernels color_sse2;
+extern const ColorKernels color_avx2;
+#endif
+
+enum ChromaFilter { chroma_nearest, chroma_bilinear };
+
+/* converts the visible part of a frame to planar rgb, h_size*v_size
+ * bytes of red, then green, then blue, the way CImg stores images.
+ * The upsampled chroma rows are kept between calls. */
+class ColorConverter {
+private:
+    std::vector<byte> cb_row, cr_row;
+    std::vector<int16_t> sums;
+public:
+    ChromaFilter filter;
+    ColorConverter(ChromaFilter __filter=chroma_bilinear);
+    void convert(const YCbCrBuffer *frame, byte *rgb);
+};
+#endif
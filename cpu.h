@@ -0,0 +1,30 @@
+#ifndef _CPU_H_
+#define _CPU_H_
+/* run time dispatch for the simd kernels. HAVE_X86_SIMD guards x86
+ * code; SSE2 and AVX2 build a single function for that instruction set
+ * whatever the compiler flags, and cpu_has_* tell whether it may run.
+ * CPU_SELECT picks the fastest of a module's kernel sets at startup. */
+#if defined(__x86_64__) or defined(__i386__)
+#define HAVE_X86_SIMD
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+inline bool cpu_has_sse2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+inline bool cpu_has_avx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#define CPU_SELECT(scalar, sse2, avx2) \
+    (cpu_has_avx2() ? (avx2) : cpu_has_sse2() ? (sse2) : (scalar))
+#else
+inline bool cpu_has_sse2() { return false; }
+inline bool cpu_has_avx2() { return false; }
+
+#define CPU_SELECT(scalar, sse2, avx2) (scalar)
+#endif
+#endif
@@ -0,0 +1,116 @@
+#include <cassert>
+#include <cstring>
+#include "frame_pool.h"
+
+byte *HeapAllocator::allocate(size_t size) {
+    return new byte[size];
+}
+
+void HeapAllocator::deallocate(byte *data, size_t) {
+    delete[] data;
+}
+
+YCbCrBuffer::YCbCrBuffer(FramePool &__pool, int __width, int __height):
+    width(__width), height(__height), h_size(__width), v_size(__height),
+    pool(__pool), refs(0) {
+    y_stride = width + 2*border;
+    c_stride = width/2 + border;
+    size_t y_size = (size_t)y_stride*(height+2*border);
+    size_t c_size = (size_t)c_stride*(height/2+border);
+    size = y_size + 2*c_size;
+    data = pool.allocator.allocate(size);
+    y = data + border*y_stride + border;
+    cb = data + y_size + border/2*c_stride + border/2;
+    cr = data + y_size + c_size + border/2*c_stride + border/2;
+}
+
+YCbCrBuffer::~YCbCrBuffer() {
+    pool.allocator.deallocate(data, size);
+}
+
+void YCbCrBuffer::retain() {
+    refs.fetch_add(1);
+}
+
+void YCbCrBuffer::release() {
+    int left = refs.fetch_sub(1) - 1;
+    assert(left >= 0);
+    if(left == 0) pool.put(this);
+}
+
+inline void extend_plane(byte *plane, int stride, int width, int height, int border) {
+    for(int i=0; i<height; ++i) {
+        byte *row = plane + i*stride;
+        memset(row-border, row[0], border);
+        memset(row+width, row[width-1], border);
+    }
+    byte *top = plane - border, *bottom = plane + (height-1)*stride - border;
+    for(int i=1; i<=border; ++i) {
+        memcpy(top - i*stride, top, width + 2*border);
+        memcpy(bottom + i*stride, bottom, width + 2*border);
+    }
+}
+
+void YCbCrBuffer::extend_edges() {
+    extend_plane(y, y_stride, width, height, border);
+    extend_plane(cb, c_stride, width/2, height/2, border/2);
+    extend_plane(cr, c_stride, width/2, height/2, border/2);
+}
+
+FramePool::FramePool(FrameAllocator &__allocator, size_t __capacity):
+    allocator(__allocator), capacity(__capacity) {
+    assert(capacity >= 3); // two references and the current picture
+    width = height = 0;
+    allocated = 0;
+}
+
+FramePool::~FramePool() {
+    // frames still held elsewhere must not outlive the pool
+    assert(free_frames.size() == allocated);
+    for(YCbCrBuffer *frame : free_frames)
+        delete frame;
+}
+
+void FramePool::set_size(int __width, int __height) {
+    std::lock_guard<std::mutex> guard(lock);
+    if(width == __width and height == __height) return;
+    width = __width;
+    height = __height;
+    for(YCbCrBuffer *frame : free_frames)
+        delete frame;
+    allocated -= free_frames.size();
+    free_frames.clear();
+    cond.notify_all();
+}
+
+YCbCrBuffer *FramePool::acquire() {
+    std::unique_lock<std::mutex> guard(lock);
+    cond.wait(guard, [this] {
+        return !free_frames.empty() or allocated < capacity;
+    });
+    YCbCrBuffer *frame;
+    if(!free_frames.empty()) {
+        frame = free_frames.back();
+        free_frames.pop_back();
+    }
+    else {
+        frame = new YCbCrBuffer(*this, width, height);
+        ++allocated;
+    }
+    frame->refs = 1;
+    return frame;
+}
+
+void FramePool::put(YCbCrBuffer *frame) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(frame->width == width and frame->height == height) {
+            free_frames.push_back(frame);
+        }
+        else {
+            delete frame;
+            --allocated;
+        }
+    }
+    cond.notify_all();
+}
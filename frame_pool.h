@@ -0,0 +1,91 @@
+#ifndef _FRAME_POOL_H_
+#define _FRAME_POOL_H_
+#include <cstddef>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "magic_code.h"
+/* where frame memory comes from, e.g. pinned or shared buffers */
+class FrameAllocator {
+public:
+    virtual ~FrameAllocator() {}
+    virtual byte *allocate(size_t size) = 0;
+    virtual void deallocate(byte *data, size_t size) = 0;
+};
+
+/* new[] and delete[] */
+class HeapAllocator : public FrameAllocator {
+public:
+    byte *allocate(size_t size);
+    void deallocate(byte *data, size_t size);
+};
+
+class FramePool;
+
+/* 8-bit planes, rows are stride bytes apart; chroma is half size.
+ * Planes are surrounded by a border that extend_edges fills by
+ * replicating the outermost pixels, so motion vectors pointing past the
+ * edges need no bounds checks.
+ * Frames are reference counted: whoever keeps a frame beyond the call
+ * that handed it over retains it, and releases it when done; the last
+ * release returns it to its pool. */
+struct YCbCrBuffer {
+    static const int border = 32; // luma, half of it for chroma
+    int width, height; // allocated, whole macroblocks
+    int h_size, v_size; // picture size, set by the decoder
+    int y_stride, c_stride;
+    byte *y, *cb, *cr; // first visible pixel
+
+    void retain();
+    void release();
+    void extend_edges();
+    /* plane and stride of block index 0-5 of a macroblock */
+    byte *plane(int index) const {
+        return index < 4 ? y : (index == 4 ? cb : cr);
+    }
+    int stride(int index) const {
+        return index < 4 ? y_stride : c_stride;
+    }
+private:
+    friend class FramePool;
+    FramePool &pool;
+    std::atomic<int> refs;
+    byte *data; // all three planes
+    size_t size;
+    YCbCrBuffer(FramePool &__pool, int __width, int __height);
+    ~YCbCrBuffer();
+};
+
+/* where decoded frames go, in display order: a window, a file writer,
+ * analysis. The frame is only lent for the call; a sink that keeps it
+ * longer retains it, and releases it before the decoder goes away. */
+class FrameSink {
+public:
+    virtual ~FrameSink() {}
+    virtual void frame(YCbCrBuffer *buf) = 0;
+};
+
+/* at most `capacity` frames of one size; acquire waits for a release
+ * when all of them are in use */
+class FramePool {
+private:
+    FrameAllocator &allocator;
+    const size_t capacity;
+    int width, height;
+    size_t allocated; // free or in use
+    std::vector<YCbCrBuffer*> free_frames;
+
+    std::mutex lock;
+    std::condition_variable cond;
+    friend struct YCbCrBuffer;
+    void put(YCbCrBuffer *frame);
+public:
+    FramePool(FrameAllocator &__allocator, size_t __capacity=8);
+    ~FramePool();
+    /* frames of another size are freed once they come back */
+    void set_size(int __width, int __height);
+    /* a frame holding one reference */
+    YCbCrBuffer *acquire();
+};
+#endif
@@ -0,0 +1,209 @@
+/* build-time generator: reads the huffman_tables text files and prints
+ * the decode tables of every VLCTable as C++ source, see Makefile */
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "bit_reader.h"
+
+class VLCBuilder {
+private:
+    const int root_bits, max_bits;
+public:
+    std::vector<VLCTable::Entry> table;
+    VLCBuilder(int __root_bits, int __max_bits):
+        root_bits(__root_bits), max_bits(__max_bits),
+        table(1 << __root_bits, VLCTable::Entry{0, 0, 0}) {
+    }
+    void insert(const char *const code, int val);
+    int lookup(uint32_t code, int &len) const;
+    void print(const char *name) const;
+};
+
+void VLCBuilder::insert(const char *const code, int val) {
+    int len = strlen(code);
+    assert(0 < len and len <= max_bits);
+    int bits = 0;
+    for(int i=0; i<len; ++i)
+        bits = (bits<<1) | (code[i]-'0');
+
+    int base = 0, table_bits = root_bits;
+    if(len > root_bits) {
+        // follow or create the link for the root prefix
+        int link = bits >> (len-root_bits);
+        assert(table[link].len == 0);
+        if(table[link].sub_bits == 0) {
+            assert(table.size() < 0x8000);
+            table[link].val = table.size();
+            table[link].sub_bits = max_bits - root_bits;
+            table.resize(table.size() + (1 << table[link].sub_bits), VLCTable::Entry{0, 0, 0});
+        }
+        base = table[link].val;
+        table_bits = table[link].sub_bits;
+        len -= root_bits;
+        bits &= (1 << len) - 1;
+    }
+    // every index starting with the code maps to it
+    int first = bits << (table_bits-len);
+    for(int i=0; i < (1 << (table_bits-len)); ++i) {
+        VLCTable::Entry &e = table[base + first + i];
+        assert(e.len == 0 and e.sub_bits == 0);
+        e.val = val;
+        e.len = len;
+    }
+}
+
+/* code holds max_bits msb first, returns the symbol and its length,
+ * which is 0 for invalid codes */
+int VLCBuilder::lookup(uint32_t code, int &len) const {
+    const VLCTable::Entry *e = &table[code >> (max_bits-root_bits)];
+    len = 0;
+    if(e->len == 0) {
+        assert(e->sub_bits != 0);
+        len = root_bits;
+        code &= (1 << (max_bits-root_bits)) - 1;
+        e = &table[e->val + (code >> (max_bits-root_bits-e->sub_bits))];
+    }
+    len = e->len == 0 ? 0 : len + e->len;
+    return e->val;
+}
+
+void VLCBuilder::print(const char *name) const {
+    printf("const VLCTable::Entry %s_entries[] = {", name);
+    for(size_t i=0; i<table.size(); ++i) {
+        if(i%8 == 0) printf("\n   ");
+        printf(" {%d, %d, %d},", table[i].val, table[i].len, table[i].sub_bits);
+    }
+    printf("\n};\n");
+    printf("const VLCTable %s(%s_entries, %d);\n\n", name, name, root_bits);
+}
+
+FILE *open_table(const std::string &dir, const char *name) {
+    FILE *file = fopen((dir + "/" + name).c_str(), "r");
+    assert(file != nullptr);
+    return file;
+}
+
+/* code value */
+void read_table(VLCBuilder &ht, const std::string &dir, const char *filename) {
+    FILE *file = open_table(dir, filename);
+    char code[32];
+    int val;
+    while(fscanf(file, "%s %d", code, &val) != EOF) {
+        ht.insert(code, val);
+    }
+    fclose(file);
+}
+
+/* code quant motion_f motion_b pattern intra, packed into mask bits */
+void read_macroblock_type_table(VLCBuilder &ht, const std::string &dir, const char *filename) {
+    FILE *file = open_table(dir, filename);
+    char code[32];
+    int tmp;
+    while(fscanf(file, "%s", code) != EOF) {
+        int val = 0;
+        for(int i=0; i<5; ++i) {
+            if(fscanf(file, "%d", &tmp) != 1) assert(false);
+            val = (val<<1) + tmp;
+        }
+        ht.insert(code, val);
+    }
+    fclose(file);
+}
+
+/* code run level; the first coefficient of a non-intra block uses '1'
+ * for run 0 level 1, later ones use '11' and '10' ends the block. The
+ * sign bit is folded into the code and the symbol is packed as
+ * run<<8 | (level & 0xFF), escapes are decoded by the caller. */
+void read_run_level_table(VLCBuilder &ht, const std::string &dir, const char *filename, bool first) {
+    FILE *file = open_table(dir, filename);
+    char code[32];
+    int run, level;
+    while(fscanf(file, "%s %d %d", code, &run, &level) != EOF) {
+        std::string prefix = code;
+        if(!first and prefix == "1") prefix = "11";
+        ht.insert((prefix + "0").c_str(), run<<8 | level);
+        ht.insert((prefix + "1").c_str(), run<<8 | (-level & 0xFF));
+    }
+    fclose(file);
+    if(!first) ht.insert("10", coef_eob);
+    ht.insert("000001", coef_escape);
+}
+
+/* decode every coef_multi_bits window greedily with the single-symbol
+ * table, stopping at escapes, at eob and at codes that do not fit */
+void print_run_level_multi(const VLCBuilder &ht, const int max_bits, const char *name) {
+    const int nbits = coef_multi_bits;
+    printf("const RunLevelEntry %s[] = {", name);
+    for(uint32_t window=0; window < (1u << nbits); ++window) {
+        RunLevelEntry e = {0, 0, 0, {0, 0, 0}, {0, 0, 0}};
+        while(e.n < 3 and !e.eob) {
+            uint32_t code = ((uint64_t)window << (max_bits-nbits+e.len)) & ((1 << max_bits) - 1);
+            int len, sym = ht.lookup(code, len);
+            if(len == 0 or e.len + len > nbits or sym == coef_escape) break;
+            e.len += len;
+            if(sym == coef_eob) {
+                e.eob = 1;
+            }
+            else {
+                e.run[e.n] = sym >> 8;
+                e.level[e.n] = (int8_t)sym;
+                ++e.n;
+            }
+        }
+        if(window%4 == 0) printf("\n   ");
+        printf(" {%d, %d, %d, {%d, %d, %d}, {%d, %d, %d}},", e.n, e.len, e.eob,
+            e.run[0], e.run[1], e.run[2], e.level[0], e.level[1], e.level[2]);
+    }
+    printf("\n};\n\n");
+}
+
+int main(int argc, char *argv[]) {
+    std::string dir = argc > 1 ? argv[1] : "huffman_tables";
+    printf("/* generated by gen_vlc_tables from %s, do not edit */\n\n", dir.c_str());
+
+    /* root table bits are tuned per table, the second number is the
+     * longest code */
+    VLCBuilder macroblock_addr(8, 11);
+    read_table(macroblock_addr, dir, "macroblock_addr.txt");
+    macroblock_addr.print("ht_macroblock_addr");
+
+    VLCBuilder coded_block_pattern(9, 9);
+    read_table(coded_block_pattern, dir, "coded_block_pattern.txt");
+    coded_block_pattern.print("ht_coded_block_pattern");
+
+    VLCBuilder motion_vector(8, 11);
+    read_table(motion_vector, dir, "motion_vector.txt");
+    motion_vector.print("ht_motion_vector");
+
+    VLCBuilder dct_dc_size_luminance(7, 7);
+    read_table(dct_dc_size_luminance, dir, "dct_dc_size_luminance.txt");
+    dct_dc_size_luminance.print("ht_dct_dc_size_luminance");
+
+    VLCBuilder dct_dc_size_chrominance(8, 8);
+    read_table(dct_dc_size_chrominance, dir, "dct_dc_size_chrominance.txt");
+    dct_dc_size_chrominance.print("ht_dct_dc_size_chrominance");
+
+    VLCBuilder intra_macroblock_type(2, 2);
+    read_macroblock_type_table(intra_macroblock_type, dir, "intra_macroblock_type.txt");
+    intra_macroblock_type.print("ht_intra_macroblock_type");
+
+    VLCBuilder p_macroblock_type(6, 6);
+    read_macroblock_type_table(p_macroblock_type, dir, "p_macroblock_type.txt");
+    p_macroblock_type.print("ht_p_macroblock_type");
+
+    VLCBuilder b_macroblock_type(6, 6);
+    read_macroblock_type_table(b_macroblock_type, dir, "b_macroblock_type.txt");
+    b_macroblock_type.print("ht_b_macroblock_type");
+
+    VLCBuilder coef_first(10, 17);
+    read_run_level_table(coef_first, dir, "run_level.txt", true);
+    coef_first.print("ht_coef_first");
+
+    VLCBuilder coef_next(10, 17);
+    read_run_level_table(coef_next, dir, "run_level.txt", false);
+    coef_next.print("ht_coef_next");
+    print_run_level_multi(coef_next, 17, "ht_coef_multi");
+    return 0;
+}
@@ -0,0 +1,371 @@
+#include "idct.h"
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* integer idct after Chen and Wang, as in the MPEG-2 reference
+ * decoder; accurate to IEEE 1180. Constants are 2048*sqrt(2)*cos(k*pi/16) */
+const int W1 = 2841;
+const int W2 = 2676;
+const int W3 = 2408;
+const int W5 = 1609;
+const int W6 = 1108;
+const int W7 = 565;
+
+static inline int iclip(int x) {
+    return x < -256 ? -256 : (x > 255 ? 255 : x);
+}
+
+/* row pass, keeps 3 extra bits of precision; results are stored to
+ * 16 bits like the reference decoder, wrapping on overflow */
+static inline void idct_row(int16_t *blk) {
+    int x0, x1, x2, x3, x4, x5, x6, x7, x8;
+    x1 = blk[4]*2048;
+    x2 = blk[6], x3 = blk[2], x4 = blk[1];
+    x5 = blk[7], x6 = blk[5], x7 = blk[3];
+    if(!(x1 | x2 | x3 | x4 | x5 | x6 | x7)) {
+        // dc only
+        int dc = blk[0]*8;
+        for(int i=0; i<8; ++i) blk[i] = dc;
+        return;
+    }
+    x0 = blk[0]*2048 + 128;
+
+    // first stage
+    x8 = W7*(x4+x5);
+    x4 = x8 + (W1-W7)*x4;
+    x5 = x8 - (W1+W7)*x5;
+    x8 = W3*(x6+x7);
+    x6 = x8 - (W3-W5)*x6;
+    x7 = x8 - (W3+W5)*x7;
+
+    // second stage
+    x8 = x0 + x1;
+    x0 -= x1;
+    x1 = W6*(x3+x2);
+    x2 = x1 - (W2+W6)*x2;
+    x3 = x1 + (W2-W6)*x3;
+    x1 = x4 + x6;
+    x4 -= x6;
+    x6 = x5 + x7;
+    x5 -= x7;
+
+    // third stage
+    x7 = x8 + x3;
+    x8 -= x3;
+    x3 = x0 + x2;
+    x0 -= x2;
+    x2 = (181*(x4+x5) + 128) >> 8;
+    x4 = (181*(x4-x5) + 128) >> 8;
+
+    // fourth stage
+    blk[0] = (x7+x1) >> 8;
+    blk[1] = (x3+x2) >> 8;
+    blk[2] = (x0+x4) >> 8;
+    blk[3] = (x8+x6) >> 8;
+    blk[4] = (x8-x6) >> 8;
+    blk[5] = (x0-x4) >> 8;
+    blk[6] = (x3-x2) >> 8;
+    blk[7] = (x7-x1) >> 8;
+}
+
+/* column pass, rounds and clips to [-256, 255] */
+static inline void idct_col(int16_t *blk) {
+    int x0, x1, x2, x3, x4, x5, x6, x7, x8;
+    x1 = blk[8*4]*256;
+    x2 = blk[8*6], x3 = blk[8*2], x4 = blk[8*1];
+    x5 = blk[8*7], x6 = blk[8*5], x7 = blk[8*3];
+    if(!(x1 | x2 | x3 | x4 | x5 | x6 | x7)) {
+        // dc only
+        int dc = iclip((blk[0]+32) >> 6);
+        for(int i=0; i<8; ++i) blk[8*i] = dc;
+        return;
+    }
+    x0 = blk[8*0]*256 + 8192;
+
+    // first stage
+    x8 = W7*(x4+x5) + 4;
+    x4 = (x8 + (W1-W7)*x4) >> 3;
+    x5 = (x8 - (W1+W7)*x5) >> 3;
+    x8 = W3*(x6+x7) + 4;
+    x6 = (x8 - (W3-W5)*x6) >> 3;
+    x7 = (x8 - (W3+W5)*x7) >> 3;
+
+    // second stage
+    x8 = x0 + x1;
+    x0 -= x1;
+    x1 = W6*(x3+x2) + 4;
+    x2 = (x1 - (W2+W6)*x2) >> 3;
+    x3 = (x1 + (W2-W6)*x3) >> 3;
+    x1 = x4 + x6;
+    x4 -= x6;
+    x6 = x5 + x7;
+    x5 -= x7;
+
+    // third stage
+    x7 = x8 + x3;
+    x8 -= x3;
+    x3 = x0 + x2;
+    x0 -= x2;
+    x2 = (181*(x4+x5) + 128) >> 8;
+    x4 = (181*(x4-x5) + 128) >> 8;
+
+    // fourth stage
+    blk[8*0] = iclip((x7+x1) >> 14);
+    blk[8*1] = iclip((x3+x2) >> 14);
+    blk[8*2] = iclip((x0+x4) >> 14);
+    blk[8*3] = iclip((x8+x6) >> 14);
+    blk[8*4] = iclip((x8-x6) >> 14);
+    blk[8*5] = iclip((x0-x4) >> 14);
+    blk[8*6] = iclip((x3-x2) >> 14);
+    blk[8*7] = iclip((x7-x1) >> 14);
+}
+
+void idct2d_scalar(int16_t blk[64]) {
+    for(int i=0; i<8; ++i)
+        idct_row(blk + 8*i);
+    for(int i=0; i<8; ++i)
+        idct_col(blk + i);
+}
+
+/* both passes reduce to a constant when only the dc is set */
+void idct2d_dc(int16_t blk[64]) {
+    int16_t row_dc = blk[0]*8;
+    int16_t dc = iclip((row_dc+32) >> 6);
+    for(int i=0; i<64; ++i) blk[i] = dc;
+}
+
+/* rows 4 to 7 are zero and stay zero after the row pass */
+void idct2d_4x4_scalar(int16_t blk[64]) {
+    for(int i=0; i<4; ++i)
+        idct_row(blk + 8*i);
+    for(int i=0; i<8; ++i)
+        idct_col(blk + i);
+}
+
+#ifdef HAVE_X86_SIMD
+/* The simd kernels run the same arithmetic on eight rows or columns at
+ * once. Pairs of inputs are interleaved so a 16x16->32 bit madd gives
+ * each first stage product sum exactly, e.g. W1*x4 + W7*x5, which is
+ * what the scalar W7*(x4+x5) + (W1-W7)*x4 works out to. 181*x is done
+ * with shifts since sse2 lacks a 32-bit multiply. The row pass is done
+ * on the transposed block, then transposed back for the column pass. */
+
+SSE2 static inline void transpose8x8(__m128i r[8]) {
+    __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]);
+    __m128i a1 = _mm_unpackhi_epi16(r[0], r[1]);
+    __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]);
+    __m128i a3 = _mm_unpackhi_epi16(r[2], r[3]);
+    __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]);
+    __m128i a5 = _mm_unpackhi_epi16(r[4], r[5]);
+    __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]);
+    __m128i a7 = _mm_unpackhi_epi16(r[6], r[7]);
+    __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+    __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+    __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+    __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+    __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+    __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+    __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+    __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+    r[0] = _mm_unpacklo_epi64(b0, b4);
+    r[1] = _mm_unpackhi_epi64(b0, b4);
+    r[2] = _mm_unpacklo_epi64(b1, b5);
+    r[3] = _mm_unpackhi_epi64(b1, b5);
+    r[4] = _mm_unpacklo_epi64(b2, b6);
+    r[5] = _mm_unpackhi_epi64(b2, b6);
+    r[6] = _mm_unpacklo_epi64(b3, b7);
+    r[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+SSE2 static inline __m128i pair16(int a, int b) {
+    return _mm_setr_epi16(a, b, a, b, a, b, a, b);
+}
+
+SSE2 static inline __m128i mul181_sse2(__m128i x) {
+    __m128i r = _mm_add_epi32(x, _mm_slli_epi32(x, 2));
+    r = _mm_add_epi32(r, _mm_slli_epi32(x, 4));
+    r = _mm_add_epi32(r, _mm_slli_epi32(x, 5));
+    return _mm_add_epi32(r, _mm_slli_epi32(x, 7));
+}
+
+/* one 1d pass over the 32-bit lanes picked by unpack (lo or hi half);
+ * p[] holds the interleaved input pairs (0,4) (1,7) (5,3) (2,6) */
+SSE2 static inline void pass_sse2(const __m128i p[4], __m128i out[8], bool col) {
+    __m128i dc_round = _mm_set1_epi32(col ? 8192 : 128);
+    __m128i round = _mm_set1_epi32(col ? 4 : 0);
+    int dc_mul = col ? 256 : 2048;
+    __m128i x8 = _mm_add_epi32(_mm_madd_epi16(p[0], pair16(dc_mul, dc_mul)), dc_round);
+    __m128i x0 = _mm_add_epi32(_mm_madd_epi16(p[0], pair16(dc_mul, -dc_mul)), dc_round);
+    __m128i x4 = _mm_add_epi32(_mm_madd_epi16(p[1], pair16(W1, W7)), round);
+    __m128i x5 = _mm_add_epi32(_mm_madd_epi16(p[1], pair16(W7, -W1)), round);
+    __m128i x6 = _mm_add_epi32(_mm_madd_epi16(p[2], pair16(W5, W3)), round);
+    __m128i x7 = _mm_add_epi32(_mm_madd_epi16(p[2], pair16(W3, -W5)), round);
+    __m128i x2 = _mm_add_epi32(_mm_madd_epi16(p[3], pair16(W6, -W2)), round);
+    __m128i x3 = _mm_add_epi32(_mm_madd_epi16(p[3], pair16(W2, W6)), round);
+    if(col) {
+        x4 = _mm_srai_epi32(x4, 3), x5 = _mm_srai_epi32(x5, 3);
+        x6 = _mm_srai_epi32(x6, 3), x7 = _mm_srai_epi32(x7, 3);
+        x2 = _mm_srai_epi32(x2, 3), x3 = _mm_srai_epi32(x3, 3);
+    }
+
+    __m128i x1 = _mm_add_epi32(x4, x6);
+    x4 = _mm_sub_epi32(x4, x6);
+    x6 = _mm_add_epi32(x5, x7);
+    x5 = _mm_sub_epi32(x5, x7);
+
+    x7 = _mm_add_epi32(x8, x3);
+    x8 = _mm_sub_epi32(x8, x3);
+    x3 = _mm_add_epi32(x0, x2);
+    x0 = _mm_sub_epi32(x0, x2);
+    __m128i r128 = _mm_set1_epi32(128);
+    x2 = _mm_srai_epi32(_mm_add_epi32(mul181_sse2(_mm_add_epi32(x4, x5)), r128), 8);
+    x4 = _mm_srai_epi32(_mm_add_epi32(mul181_sse2(_mm_sub_epi32(x4, x5)), r128), 8);
+
+    out[0] = _mm_add_epi32(x7, x1);
+    out[1] = _mm_add_epi32(x3, x2);
+    out[2] = _mm_add_epi32(x0, x4);
+    out[3] = _mm_add_epi32(x8, x6);
+    out[4] = _mm_sub_epi32(x8, x6);
+    out[5] = _mm_sub_epi32(x0, x4);
+    out[6] = _mm_sub_epi32(x3, x2);
+    out[7] = _mm_sub_epi32(x7, x1);
+}
+
+/* shift and narrow to 16 bits: the row pass wraps like the scalar
+ * stores, the column pass clips to [-256, 255] */
+SSE2 static inline __m128i narrow_sse2(__m128i lo, __m128i hi, bool col) {
+    if(col) {
+        __m128i v = _mm_packs_epi32(_mm_srai_epi32(lo, 14), _mm_srai_epi32(hi, 14));
+        v = _mm_max_epi16(v, _mm_set1_epi16(-256));
+        return _mm_min_epi16(v, _mm_set1_epi16(255));
+    }
+    lo = _mm_srai_epi32(_mm_slli_epi32(lo, 8), 16);
+    hi = _mm_srai_epi32(_mm_slli_epi32(hi, 8), 16);
+    return _mm_packs_epi32(lo, hi);
+}
+
+/* r[k] holds input k of all eight lanes */
+SSE2 static inline void idct_pass_sse2(__m128i r[8], bool col) {
+    const int pairs[4][2] = {{0, 4}, {1, 7}, {5, 3}, {2, 6}};
+    __m128i lo[4], hi[4], out_lo[8], out_hi[8];
+    for(int k=0; k<4; ++k) {
+        lo[k] = _mm_unpacklo_epi16(r[pairs[k][0]], r[pairs[k][1]]);
+        hi[k] = _mm_unpackhi_epi16(r[pairs[k][0]], r[pairs[k][1]]);
+    }
+    pass_sse2(lo, out_lo, col);
+    pass_sse2(hi, out_hi, col);
+    for(int k=0; k<8; ++k)
+        r[k] = narrow_sse2(out_lo[k], out_hi[k], col);
+}
+
+SSE2 void idct2d_sse2(int16_t blk[64]) {
+    __m128i r[8];
+    for(int i=0; i<8; ++i)
+        r[i] = _mm_loadu_si128((const __m128i*)(blk + 8*i));
+    transpose8x8(r);
+    idct_pass_sse2(r, false);
+    transpose8x8(r);
+    idct_pass_sse2(r, true);
+    for(int i=0; i<8; ++i)
+        _mm_storeu_si128((__m128i*)(blk + 8*i), r[i]);
+}
+
+/* only rows 0 to 3 are set, so the row pass needs the low half alone */
+SSE2 void idct2d_4x4_sse2(int16_t blk[64]) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i r[8];
+    for(int i=0; i<4; ++i)
+        r[i] = _mm_loadu_si128((const __m128i*)(blk + 8*i));
+    for(int i=4; i<8; ++i)
+        r[i] = zero;
+    transpose8x8(r);
+    __m128i p[4] = {
+        _mm_unpacklo_epi16(r[0], zero), _mm_unpacklo_epi16(r[1], zero),
+        _mm_unpacklo_epi16(zero, r[3]), _mm_unpacklo_epi16(r[2], zero)};
+    __m128i out[8];
+    pass_sse2(p, out, false);
+    for(int k=0; k<8; ++k)
+        r[k] = narrow_sse2(out[k], zero, false);
+    transpose8x8(r);
+    idct_pass_sse2(r, true);
+    for(int i=0; i<8; ++i)
+        _mm_storeu_si128((__m128i*)(blk + 8*i), r[i]);
+}
+
+AVX2 static inline __m256i pair16_avx2(int a, int b) {
+    return _mm256_setr_epi16(a, b, a, b, a, b, a, b, a, b, a, b, a, b, a, b);
+}
+
+AVX2 static inline __m256i mul181_avx2(__m256i x) {
+    __m256i r = _mm256_add_epi32(x, _mm256_slli_epi32(x, 2));
+    r = _mm256_add_epi32(r, _mm256_slli_epi32(x, 4));
+    r = _mm256_add_epi32(r, _mm256_slli_epi32(x, 5));
+    return _mm256_add_epi32(r, _mm256_slli_epi32(x, 7));
+}
+
+/* same as the sse2 pass, but all eight 32-bit lanes fit one register */
+AVX2 static inline void idct_pass_avx2(__m128i r[8], bool col) {
+    const int pairs[4][2] = {{0, 4}, {1, 7}, {5, 3}, {2, 6}};
+    __m256i p[4];
+    for(int k=0; k<4; ++k) {
+        __m128i a = r[pairs[k][0]], b = r[pairs[k][1]];
+        p[k] = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_unpacklo_epi16(a, b)),
+            _mm_unpackhi_epi16(a, b), 1);
+    }
+    __m256i dc_round = _mm256_set1_epi32(col ? 8192 : 128);
+    __m256i round = _mm256_set1_epi32(col ? 4 : 0);
+    int dc_mul = col ? 256 : 2048;
+    __m256i x8 = _mm256_add_epi32(_mm256_madd_epi16(p[0], pair16_avx2(dc_mul, dc_mul)), dc_round);
+    __m256i x0 = _mm256_add_epi32(_mm256_madd_epi16(p[0], pair16_avx2(dc_mul, -dc_mul)), dc_round);
+    __m256i x4 = _mm256_add_epi32(_mm256_madd_epi16(p[1], pair16_avx2(W1, W7)), round);
+    __m256i x5 = _mm256_add_epi32(_mm256_madd_epi16(p[1], pair16_avx2(W7, -W1)), round);
+    __m256i x6 = _mm256_add_epi32(_mm256_madd_epi16(p[2], pair16_avx2(W5, W3)), round);
+    __m256i x7 = _mm256_add_epi32(_mm256_madd_epi16(p[2], pair16_avx2(W3, -W5)), round);
+    __m256i x2 = _mm256_add_epi32(_mm256_madd_epi16(p[3], pair16_avx2(W6, -W2)), round);
+    __m256i x3 = _mm256_add_epi32(_mm256_madd_epi16(p[3], pair16_avx2(W2, W6)), round);
+    if(col) {
+        x4 = _mm256_srai_epi32(x4, 3), x5 = _mm256_srai_epi32(x5, 3);
+        x6 = _mm256_srai_epi32(x6, 3), x7 = _mm256_srai_epi32(x7, 3);
+        x2 = _mm256_srai_epi32(x2, 3), x3 = _mm256_srai_epi32(x3, 3);
+    }
+
+    __m256i x1 = _mm256_add_epi32(x4, x6);
+    x4 = _mm256_sub_epi32(x4, x6);
+    x6 = _mm256_add_epi32(x5, x7);
+    x5 = _mm256_sub_epi32(x5, x7);
+
+    x7 = _mm256_add_epi32(x8, x3);
+    x8 = _mm256_sub_epi32(x8, x3);
+    x3 = _mm256_add_epi32(x0, x2);
+    x0 = _mm256_sub_epi32(x0, x2);
+    __m256i r128 = _mm256_set1_epi32(128);
+    x2 = _mm256_srai_epi32(_mm256_add_epi32(mul181_avx2(_mm256_add_epi32(x4, x5)), r128), 8);
+    x4 = _mm256_srai_epi32(_mm256_add_epi32(mul181_avx2(_mm256_sub_epi32(x4, x5)), r128), 8);
+
+    __m256i out[8] = {
+        _mm256_add_epi32(x7, x1), _mm256_add_epi32(x3, x2),
+        _mm256_add_epi32(x0, x4), _mm256_add_epi32(x8, x6),
+        _mm256_sub_epi32(x8, x6), _mm256_sub_epi32(x0, x4),
+        _mm256_sub_epi32(x3, x2), _mm256_sub_epi32(x7, x1)};
+    for(int k=0; k<8; ++k)
+        r[k] = narrow_sse2(_mm256_castsi256_si128(out[k]),
+            _mm256_extracti128_si256(out[k], 1), col);
+}
+
+AVX2 void idct2d_avx2(int16_t blk[64]) {
+    __m128i r[8];
+    for(int i=0; i<8; ++i)
+        r[i] = _mm_loadu_si128((const __m128i*)(blk + 8*i));
+    transpose8x8(r);
+    idct_pass_avx2(r, false);
+    transpose8x8(r);
+    idct_pass_avx2(r, true);
+    for(int i=0; i<8; ++i)
+        _mm_storeu_si128((__m128i*)(blk + 8*i), r[i]);
+}
+#endif
+
+const IDCTKernel idct2d = CPU_SELECT(idct2d_scalar, idct2d_sse2, idct2d_avx2);
+const IDCTKernel idct2d_4x4 = CPU_SELECT(idct2d_4x4_scalar, idct2d_4x4_sse2, idct2d_4x4_sse2);
@@ -0,0 +1,23 @@
+#ifndef _IDCT_H_
+#define _IDCT_H_
+#include <cstdint>
+#include "cpu.h"
+/* 8x8 inverse dct in place on a row major block, output clipped to
+ * [-256, 255]. Every kernel gives the same result bit for bit; idct2d
+ * points at the fastest one the cpu supports, picked at startup. */
+typedef void (*IDCTKernel)(int16_t blk[64]);
+extern const IDCTKernel idct2d;
+
+/* shortcuts for sparse blocks, same results as the full transform:
+ * only blk[0] set, or only the top left 4x4 (zigzag index < 10) set */
+void idct2d_dc(int16_t blk[64]);
+extern const IDCTKernel idct2d_4x4;
+
+void idct2d_scalar(int16_t blk[64]);
+void idct2d_4x4_scalar(int16_t blk[64]);
+#ifdef HAVE_X86_SIMD
+void idct2d_sse2(int16_t blk[64]);
+void idct2d_avx2(int16_t blk[64]);
+void idct2d_4x4_sse2(int16_t blk[64]);
+#endif
+#endif
@@ -0,0 +1,145 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include "idct.h"
+/* IEEE 1180-1990 accuracy test of the idct kernels: 10000 random blocks
+ * for each input range and sign, forward transformed and rounded in
+ * double precision, then inverse transformed by a kernel and compared
+ * against the double precision inverse. The dc-only and 4x4 shortcuts
+ * must also give exactly what the full transform gives. */
+
+struct Kernel {
+    const char *name;
+    IDCTKernel full, sparse;
+};
+
+static uint32_t randx; // unsigned, so the multiply wraps as the standard's 32-bit long
+
+/* the standard's generator, uniform over [-low, high] */
+static long ieee_rand(long low, long high) {
+    static const double z = (double)0x7fffffff;
+    randx = randx*1103515245 + 12345;
+    long i = randx & 0x7ffffffe;
+    double x = (double)i/z*(low+high+1);
+    return (long)x - low;
+}
+
+static double c[8][8]; // c[u][x] = basis u at sample x
+
+static void init_basis() {
+    for(int u=0; u<8; ++u)
+        for(int x=0; x<8; ++x)
+            c[u][x] = (u ? 0.5 : sqrt(0.125))*cos((2*x+1)*u*M_PI/16);
+}
+
+static void fdct_ref(const double in[64], double out[64]) {
+    for(int u=0; u<8; ++u)
+        for(int v=0; v<8; ++v) {
+            double sum = 0;
+            for(int x=0; x<8; ++x)
+                for(int y=0; y<8; ++y)
+                    sum += c[u][x]*c[v][y]*in[x*8+y];
+            out[u*8+v] = sum;
+        }
+}
+
+static void idct_ref(const double in[64], double out[64]) {
+    for(int x=0; x<8; ++x)
+        for(int y=0; y<8; ++y) {
+            double sum = 0;
+            for(int u=0; u<8; ++u)
+                for(int v=0; v<8; ++v)
+                    sum += c[u][x]*c[v][y]*in[u*8+v];
+            out[x*8+y] = sum;
+        }
+}
+
+static double clamp(double v, double low, double high) {
+    return v < low ? low : (v > high ? high : v);
+}
+
+/* one range and sign; returns whether it passes */
+static bool run_case(const Kernel &kernel, long low, long high, int sign) {
+    const int blocks = 10000;
+    double err_sum[64] = {0}, err_sq[64] = {0};
+    int peak = 0;
+    bool shortcuts = true;
+    randx = 1;
+    for(int n=0; n<blocks; ++n) {
+        double in[64], coef[64], ref[64];
+        for(int i=0; i<64; ++i)
+            in[i] = sign*ieee_rand(low, high);
+        fdct_ref(in, coef);
+        int16_t blk[64];
+        for(int i=0; i<64; ++i) {
+            coef[i] = clamp(floor(coef[i] + 0.5), -2048, 2047);
+            blk[i] = coef[i];
+        }
+        idct_ref(coef, ref);
+
+        // shortcuts against the full transform on the same coefficients
+        int16_t dc[64] = {0}, dc_full[64] = {0}, sub[64] = {0}, sub_full[64] = {0};
+        dc[0] = dc_full[0] = blk[0];
+        for(int i=0; i<4; ++i)
+            for(int j=0; j<4; ++j)
+                sub[i*8+j] = sub_full[i*8+j] = blk[i*8+j];
+        idct2d_dc(dc);
+        kernel.full(dc_full);
+        kernel.sparse(sub);
+        kernel.full(sub_full);
+        if(memcmp(dc, dc_full, sizeof(dc)) or memcmp(sub, sub_full, sizeof(sub)))
+            shortcuts = false;
+
+        kernel.full(blk);
+        for(int i=0; i<64; ++i) {
+            int err = blk[i] - (int)clamp(floor(ref[i] + 0.5), -256, 255);
+            peak = std::max(peak, std::abs(err));
+            err_sum[i] += err;
+            err_sq[i] += err*err;
+        }
+    }
+
+    double pmse = 0, pme = 0, omse = 0, ome = 0;
+    for(int i=0; i<64; ++i) {
+        pmse = std::max(pmse, err_sq[i]/blocks);
+        pme = std::max(pme, std::fabs(err_sum[i])/blocks);
+        omse += err_sq[i];
+        ome += err_sum[i];
+    }
+    omse /= 64.*blocks;
+    ome = std::fabs(ome)/(64.*blocks);
+    bool pass = peak <= 1 and pmse <= 0.06 and omse <= 0.02
+        and pme <= 0.015 and ome <= 0.0015 and shortcuts;
+    printf("%-6s -L %3ld -H %3ld sign %+d: peak %d pmse %.4f omse %.4f pme %.4f ome %.5f%s %s\n",
+        kernel.name, low, high, sign, peak, pmse, omse, pme, ome,
+        shortcuts ? "" : " shortcuts differ", pass ? "pass" : "FAIL");
+    return pass;
+}
+
+int main() {
+    init_basis();
+    Kernel kernels[3];
+    int count = 0;
+    kernels[count++] = {"scalar", idct2d_scalar, idct2d_4x4_scalar};
+#ifdef HAVE_X86_SIMD
+    if(cpu_has_sse2()) kernels[count++] = {"sse2", idct2d_sse2, idct2d_4x4_sse2};
+    if(cpu_has_avx2()) kernels[count++] = {"avx2", idct2d_avx2, idct2d_4x4_sse2};
+#endif
+    const long ranges[3][2] = {{256, 255}, {5, 5}, {300, 300}};
+    bool pass = true;
+    for(int k=0; k<count; ++k) {
+        for(int r=0; r<3; ++r)
+            for(int sign=1; sign>=-1; sign-=2)
+                pass &= run_case(kernels[k], ranges[r][0], ranges[r][1], sign);
+        // all zero in, all zero out
+        int16_t zero[64] = {0};
+        kernels[k].full(zero);
+        for(int i=0; i<64; ++i)
+            if(zero[i]) pass = false;
+    }
+    printf("IEEE 1180 %s\n", pass ? "pass" : "FAIL");
+    return pass ? 0 : 1;
+}
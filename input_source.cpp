@@ -0,0 +1,80 @@
+#include <cassert>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "input_source.h"
+
+FileSource::FileSource(FILE *__file, size_t buffer_size):
+    file(__file), buffer(buffer_size) {
+}
+
+size_t FileSource::next_chunk(const byte *&data) {
+    data = buffer.data();
+    return fread(buffer.data(), 1, buffer.size(), file);
+}
+
+StreamSource::StreamSource(int __fd, size_t ring_size):
+    fd(__fd), ring(ring_size) {
+    head = 0;
+}
+
+size_t StreamSource::next_chunk(const byte *&chunk) {
+    const size_t max_read = ring.size()/4;
+    if(ring.size()-head < max_read) head = 0; // wrap around
+    ssize_t size;
+    do {
+        size = read(fd, ring.data()+head, max_read);
+    } while(size < 0 and errno == EINTR);
+    if(size <= 0) return 0;
+    chunk = ring.data()+head;
+    head += size;
+    return size;
+}
+
+MemorySource::MemorySource(const uint8_t *__data, size_t __size) {
+    next = 0;
+    append(__data, __size);
+}
+
+void MemorySource::append(const uint8_t *__data, size_t __size) {
+    if(__size > 0) spans.emplace_back(__data, __size);
+}
+
+size_t MemorySource::next_chunk(const byte *&chunk) {
+    if(next == spans.size()) return 0;
+    chunk = spans[next].first;
+    return spans[next++].second;
+}
+
+MappedSource::MappedSource(const char *filename) {
+    map = nullptr;
+    size = 0;
+    done = false;
+    int fd = open(filename, O_RDONLY);
+    assert(fd >= 0);
+    struct stat st;
+    fstat(fd, &st);
+    size = st.st_size;
+    if(size > 0) {
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        assert(addr != MAP_FAILED);
+        map = (byte*)addr;
+        // read ahead aggressively and drop pages behind us
+        madvise(map, size, MADV_SEQUENTIAL);
+        madvise(map, size, MADV_WILLNEED);
+    }
+    close(fd); // the mapping keeps the file referenced
+}
+
+MappedSource::~MappedSource() {
+    if(map) munmap(map, size);
+}
+
+size_t MappedSource::next_chunk(const byte *&chunk) {
+    if(done or map == nullptr) return 0;
+    done = true;
+    chunk = map;
+    return size;
+}
@@ -0,0 +1,64 @@
+#ifndef _INPUT_SOURCE_H_
+#define _INPUT_SOURCE_H_
+#include <cstdio>
+#include <vector>
+#include <utility>
+#include "magic_code.h"
+/* supplies the elementary stream to BitReader chunk by chunk */
+class InputSource {
+public:
+    virtual ~InputSource() {}
+    /* point data at the next chunk, valid until the following call;
+     * returns its size, 0 at end of input */
+    virtual size_t next_chunk(const byte *&data) = 0;
+};
+
+/* fread into a buffer */
+class FileSource : public InputSource {
+private:
+    FILE *const file;
+    std::vector<byte> buffer;
+public:
+    FileSource(FILE *__file, size_t buffer_size=1<<16);
+    size_t next_chunk(const byte *&data);
+};
+
+/* read(2) from a pipe, socket or any other descriptor that cannot
+ * seek; every read is handed out as soon as it arrives, from successive
+ * slices of a fixed ring so a slow writer never stalls a full buffer */
+class StreamSource : public InputSource {
+private:
+    const int fd;
+    std::vector<byte> ring;
+    size_t head;
+public:
+    StreamSource(int __fd, size_t ring_size=1<<18);
+    size_t next_chunk(const byte *&chunk);
+};
+
+/* caller-owned bytes, handed out without copying; appended spans
+ * are read back to back as one stream */
+class MemorySource : public InputSource {
+private:
+    std::vector<std::pair<const byte*, size_t>> spans;
+    size_t next;
+public:
+    MemorySource(const uint8_t *__data, size_t __size);
+    void append(const uint8_t *__data, size_t __size);
+    size_t next_chunk(const byte *&chunk);
+};
+
+/* mmap the whole file and hand it out as a single chunk */
+class MappedSource : public InputSource {
+private:
+    byte *map;
+    size_t size;
+    bool done;
+public:
+    MappedSource(const char *filename);
+    ~MappedSource();
+    const byte *data() const { return map; }
+    size_t length() const { return size; }
+    size_t next_chunk(const byte *&chunk);
+};
+#endif
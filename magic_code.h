@@ -1,2 +1,10 @@
+#include <cstdint>
 typedef unsigned char byte;
-extern const char start_code[];
+extern const uint32_t start_code;
+extern const uint32_t picture_start_code;
+extern const uint32_t user_data_start_code;
+extern const uint32_t sequence_header_code;
+extern const uint32_t sequence_error_code;
+extern const uint32_t extension_start_code;
+extern const uint32_t sequence_end_code;
+extern const uint32_t group_start_code;
@@ -1,13 +1,122 @@
 #include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
 #include "magic_code.h"
+#include "input_source.h"
+#include "read_ahead.h"
 #include "bit_reader.h"
+#include "stream_index.h"
 #include "video.h"
+#include "video_display.h"
 
 int main(int argc, char *argv[]) {
-    FILE *file = fopen(argv[1], "rb");
-    BitReader stream(file);
-    VideoDecoder decoder;
-    decoder.video_sequence(stream);
-    fclose(file);
+    bool use_mmap = false, make_index = false, bad_option = false;
+    bool use_read_ahead = false;
+    ChromaFilter chroma = chroma_bilinear;
+    int seek_picture = -1, read_ahead = 0;
+    int opt;
+    while((opt = getopt(argc, argv, "mnis:r:")) != -1) {
+        if(opt == 'm') use_mmap = true; // memory-mapped input
+        else if(opt == 'i') make_index = true; // write sidecar and exit
+        else if(opt == 's') seek_picture = atoi(optarg); // start from sidecar
+        else if(opt == 'r') { // background read depth
+            use_read_ahead = true;
+            read_ahead = atoi(optarg);
+        }
+        else if(opt == 'n') chroma = chroma_nearest; // cheaper upsampling
+        else bad_option = true;
+    }
+    // -r needs a buffer for the reader and one for the decoder, and
+    // replaces the other ways of reading the file
+    if(use_read_ahead and (read_ahead < 2 or use_mmap or seek_picture >= 0))
+        bad_option = true;
+    if(make_index and seek_picture >= 0)
+        bad_option = true;
+    if(bad_option or optind >= argc) {
+        fprintf(stderr, "usage: %s [-m | -r depth>=2] [-n] [-i | -s picture] file|-\n", argv[0]);
+        return 1;
+    }
+    const char *filename = argv[optind];
+    bool use_stdin = std::string(filename) == "-";
+    if(use_stdin and (use_mmap or make_index or seek_picture >= 0)) {
+        fprintf(stderr, "-m, -i and -s need a file, not stdin\n");
+        return 1;
+    }
+    std::string index_name = std::string(filename) + ".idx";
+
+    FILE *file = nullptr;
+    int fd = -1;
+    MappedSource *mapped = nullptr;
+    ReadAheadSource *prefetch = nullptr;
+    InputSource *input;
+    if(use_read_ahead) {
+        fd = use_stdin ? STDIN_FILENO : open(filename, O_RDONLY);
+        if(fd < 0) {
+            perror(filename);
+            return 1;
+        }
+        input = prefetch = new ReadAheadSource(fd, read_ahead);
+    }
+    else if(use_stdin) {
+        input = new StreamSource(STDIN_FILENO);
+    }
+    else if(seek_picture >= 0) {
+        // splice the sequence header in front of the gop holding the picture
+        mapped = new MappedSource(filename);
+        StreamIndex index(index_name.c_str(), filename, *mapped);
+        if(index.rescanned())
+            fprintf(stderr, "%s missing or out of date, scanning %s\n",
+                index_name.c_str(), filename);
+        size_t seq, gop;
+        if(!index.seek_point(seek_picture, seq, gop)) {
+            fprintf(stderr, "picture %d not in %s\n", seek_picture, filename);
+            delete mapped;
+            return 1;
+        }
+        // never splice outside the mapping
+        if(seq+1 >= index.size() or index[seq+1].offset > mapped->length()
+            or index[gop].offset >= mapped->length()) {
+            fprintf(stderr, "%s does not match %s\n", index_name.c_str(), filename);
+            delete mapped;
+            return 1;
+        }
+        MemorySource *spliced = new MemorySource(mapped->data() + index[seq].offset,
+            index[seq+1].offset - index[seq].offset);
+        spliced->append(mapped->data() + index[gop].offset,
+            mapped->length() - index[gop].offset);
+        input = spliced;
+    }
+    else if(use_mmap) {
+        input = mapped = new MappedSource(filename);
+    }
+    else {
+        file = fopen(filename, "rb");
+        input = new FileSource(file);
+    }
+
+    BitReader stream(*input);
+    if(make_index) {
+        std::vector<IndexEntry> entries;
+        build_index(stream, entries);
+        write_index(index_name.c_str(), filename, entries);
+    }
+    else {
+        DisplaySink display(chroma);
+        VideoDecoder decoder(display);
+        decoder.video_sequence(stream);
+    }
+
+    if(prefetch) {
+        ReadAheadStats stats = prefetch->get_stats();
+        fprintf(stderr, "read-ahead: %llu chunks, %llu stalls, %.3f s stalled\n",
+            (unsigned long long)stats.chunks, (unsigned long long)stats.stalls,
+            stats.stall_seconds);
+    }
+    if(input != mapped) delete input;
+    delete mapped;
+    if(file) fclose(file);
+    if(fd > STDIN_FILENO) close(fd);
     return 0;
 }
@@ -0,0 +1,180 @@
+#include "mc.h"
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* MODE holds the half-pel flags, AVG averages into dst */
+template<int MODE>
+static inline int pel(const byte *p, int stride) {
+    switch(MODE) {
+        case 0: return p[0];
+        case 1: return (p[0] + p[1] + 1) >> 1;
+        case 2: return (p[0] + p[stride] + 1) >> 1;
+        default: return (p[0] + p[1] + p[stride] + p[stride+1] + 2) >> 2;
+    }
+}
+
+template<int MODE, bool AVG>
+static void mc_block_scalar(byte *dst, int dst_stride,
+        const byte *src, int src_stride, int width, int height) {
+    for(int i=0; i<height; ++i, dst+=dst_stride, src+=src_stride)
+        for(int j=0; j<width; ++j) {
+            int v = pel<MODE>(src+j, src_stride);
+            dst[j] = AVG ? (dst[j] + v + 1) >> 1 : v;
+        }
+}
+
+static inline byte clip(int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+template<bool ADD>
+static void residual_scalar(byte *dst, int stride, const int16_t blk[64]) {
+    for(int i=0; i<8; ++i, dst+=stride, blk+=8)
+        for(int j=0; j<8; ++j)
+            dst[j] = clip(ADD ? dst[j] + blk[j] : blk[j]);
+}
+
+const MCKernels mc_scalar = {
+    {mc_block_scalar<0, false>, mc_block_scalar<1, false>,
+     mc_block_scalar<2, false>, mc_block_scalar<3, false>},
+    {mc_block_scalar<0, true>, mc_block_scalar<1, true>,
+     mc_block_scalar<2, true>, mc_block_scalar<3, true>},
+    residual_scalar<false>, residual_scalar<true>
+};
+
+#ifdef HAVE_X86_SIMD
+/* pavgb rounds like MPEG-1 for two pixels; four pixel averages are
+ * summed in 16 bits, reusing each row's horizontal sum for the next
+ * output row. Blocks 8 wide use the low half of a register. */
+
+template<int W>
+SSE2 static inline __m128i load_row(const byte *p) {
+    if(W == 16) return _mm_loadu_si128((const __m128i*)p);
+    return _mm_loadl_epi64((const __m128i*)p);
+}
+
+template<int W>
+SSE2 static inline void store_row(byte *p, __m128i v) {
+    if(W == 16) _mm_storeu_si128((__m128i*)p, v);
+    else _mm_storel_epi64((__m128i*)p, v);
+}
+
+template<int W, bool AVG>
+SSE2 static inline void put_row(byte *dst, __m128i v) {
+    if(AVG) v = _mm_avg_epu8(v, load_row<W>(dst));
+    store_row<W>(dst, v);
+}
+
+template<int W, int MODE, bool AVG>
+SSE2 static void mc_block_sse2_w(byte *dst, int dst_stride,
+        const byte *src, int src_stride, int height) {
+    const __m128i zero = _mm_setzero_si128();
+    if(MODE == 3) {
+        // horizontal sums of the row above, low and high halves
+        __m128i a = load_row<W>(src), b = load_row<W>(src+1);
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        const __m128i two = _mm_set1_epi16(2);
+        for(int i=0; i<height; ++i, dst+=dst_stride) {
+            src += src_stride;
+            a = load_row<W>(src), b = load_row<W>(src+1);
+            __m128i next_lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            __m128i next_hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            __m128i out_lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, next_lo), two), 2);
+            __m128i out_hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, next_hi), two), 2);
+            put_row<W, AVG>(dst, _mm_packus_epi16(out_lo, out_hi));
+            lo = next_lo, hi = next_hi;
+        }
+        return;
+    }
+    for(int i=0; i<height; ++i, dst+=dst_stride, src+=src_stride) {
+        __m128i v = load_row<W>(src);
+        if(MODE == 1) v = _mm_avg_epu8(v, load_row<W>(src+1));
+        if(MODE == 2) v = _mm_avg_epu8(v, load_row<W>(src+src_stride));
+        put_row<W, AVG>(dst, v);
+    }
+}
+
+/* 16 pixel columns, then an 8 pixel one if left over */
+template<int MODE, bool AVG>
+SSE2 static void mc_block_sse2(byte *dst, int dst_stride,
+        const byte *src, int src_stride, int width, int height) {
+    int x = 0;
+    for(; x+16<=width; x+=16)
+        mc_block_sse2_w<16, MODE, AVG>(dst+x, dst_stride, src+x, src_stride, height);
+    if(x < width)
+        mc_block_sse2_w<8, MODE, AVG>(dst+x, dst_stride, src+x, src_stride, height);
+}
+
+/* two rows per iteration; the idct output is within [-256, 255], so
+ * adding a pixel cannot overflow 16 bits and packus does the clipping */
+template<bool ADD>
+SSE2 static void residual_sse2(byte *dst, int stride, const int16_t blk[64]) {
+    const __m128i zero = _mm_setzero_si128();
+    for(int i=0; i<8; i+=2, dst+=2*stride, blk+=16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)blk);
+        __m128i b = _mm_loadu_si128((const __m128i*)(blk+8));
+        if(ADD) {
+            a = _mm_add_epi16(a, _mm_unpacklo_epi8(load_row<8>(dst), zero));
+            b = _mm_add_epi16(b, _mm_unpacklo_epi8(load_row<8>(dst+stride), zero));
+        }
+        __m128i v = _mm_packus_epi16(a, b);
+        store_row<8>(dst, v);
+        store_row<8>(dst+stride, _mm_unpackhi_epi64(v, v));
+    }
+}
+
+const MCKernels mc_sse2 = {
+    {mc_block_sse2<0, false>, mc_block_sse2<1, false>,
+     mc_block_sse2<2, false>, mc_block_sse2<3, false>},
+    {mc_block_sse2<0, true>, mc_block_sse2<1, true>,
+     mc_block_sse2<2, true>, mc_block_sse2<3, true>},
+    residual_sse2<false>, residual_sse2<true>
+};
+
+/* avx2 widens a whole 16 pixel row into one register for the four
+ * pixel average; the two pixel cases and the 8 pixel wide residuals
+ * gain nothing over sse2 */
+template<bool AVG>
+AVX2 static inline void mc_column_hv_avx2(byte *dst, int dst_stride,
+        const byte *src, int src_stride, int height) {
+    const __m256i two = _mm256_set1_epi16(2);
+    __m256i sum = _mm256_add_epi16(
+        _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)src)),
+        _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src+1))));
+    for(int i=0; i<height; ++i, dst+=dst_stride) {
+        src += src_stride;
+        __m256i next = _mm256_add_epi16(
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)src)),
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src+1))));
+        __m256i out = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(sum, next), two), 2);
+        // packus works within 128-bit lanes, gather the two low quarters
+        out = _mm256_permute4x64_epi64(_mm256_packus_epi16(out, out), 0x08);
+        __m128i v = _mm256_castsi256_si128(out);
+        if(AVG) v = _mm_avg_epu8(v, _mm_loadu_si128((const __m128i*)dst));
+        _mm_storeu_si128((__m128i*)dst, v);
+        sum = next;
+    }
+}
+
+template<bool AVG>
+AVX2 static void mc_block_hv_avx2(byte *dst, int dst_stride,
+        const byte *src, int src_stride, int width, int height) {
+    int x = 0;
+    for(; x+16<=width; x+=16)
+        mc_column_hv_avx2<AVG>(dst+x, dst_stride, src+x, src_stride, height);
+    if(x < width)
+        mc_block_sse2_w<8, 3, AVG>(dst+x, dst_stride, src+x, src_stride, height);
+}
+
+const MCKernels mc_avx2 = {
+    {mc_block_sse2<0, false>, mc_block_sse2<1, false>,
+     mc_block_sse2<2, false>, mc_block_hv_avx2<false>},
+    {mc_block_sse2<0, true>, mc_block_sse2<1, true>,
+     mc_block_sse2<2, true>, mc_block_hv_avx2<true>},
+    residual_sse2<false>, residual_sse2<true>
+};
+#endif
+
+const MCKernels *const mc = CPU_SELECT(&mc_scalar, &mc_sse2, &mc_avx2);
@@ -0,0 +1,32 @@
+#ifndef _MC_H_
+#define _MC_H_
+#include <cstdint>
+#include "magic_code.h"
+#include "cpu.h"
+/* motion compensation kernels on 8-bit planes. They predict a block
+ * any multiple of 8 pixels wide and any number of rows high from src,
+ * so a run of macroblocks sharing a vector takes one call. They are
+ * indexed by the half-pel flags right_half | down_half<<1. put stores
+ * the prediction; avg averages it into dst, which is how b macroblocks
+ * combine their forward and backward predictions. Averages round as
+ * MPEG-1 requires: (a+b+1)>>1 and (a+b+c+d+2)>>2. */
+typedef void (*MCKernel)(byte *dst, int dst_stride,
+    const byte *src, int src_stride, int width, int height);
+/* the last step of reconstruction on an 8x8 block: put_residual stores
+ * an idct output saturated to 8 bits, add_residual adds it to the
+ * prediction already in dst and saturates */
+typedef void (*ResidualKernel)(byte *dst, int stride, const int16_t blk[64]);
+struct MCKernels {
+    MCKernel put[4];
+    MCKernel avg[4];
+    ResidualKernel put_residual;
+    ResidualKernel add_residual;
+};
+extern const MCKernels *const mc; // see cpu.h
+
+extern const MCKernels mc_scalar;
+#ifdef HAVE_X86_SIMD
+extern const MCKernels mc_sse2;
+extern const MCKernels mc_avx2;
+#endif
+#endif
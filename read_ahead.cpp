@@ -0,0 +1,95 @@
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <unistd.h>
+#include <poll.h>
+#include "read_ahead.h"
+
+ReadAheadSource::ReadAheadSource(int __fd, int depth, size_t chunk_size):
+    fd(__fd), slots(depth) {
+    assert(fd >= 0); // poll would skip it and the reader wait forever
+    assert(depth >= 2); // one held by the bit reader, one being filled
+    for(Slot &slot : slots) {
+        slot.data.resize(chunk_size);
+        slot.size = 0;
+    }
+    filled = consumed = released = 0;
+    done = stop = false;
+    stats.chunks = stats.stalls = 0;
+    stats.stall_seconds = 0;
+    int pipe_result = pipe(wake);
+    assert(pipe_result == 0);
+    reader = std::thread(&ReadAheadSource::run, this);
+}
+
+ReadAheadSource::~ReadAheadSource() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    cond.notify_all();
+    // the reader may be waiting for input that never comes
+    ssize_t written = write(wake[1], "", 1);
+    assert(written == 1);
+    reader.join();
+    close(wake[0]);
+    close(wake[1]);
+}
+
+/* reader thread */
+void ReadAheadSource::run() {
+    while(true) {
+        Slot *slot;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [this] {
+                return stop or filled-released < slots.size();
+            });
+            if(stop) return;
+            slot = &slots[filled % slots.size()];
+        }
+        // wait for input or shutdown, then take whatever one read gives
+        pollfd fds[2] = {{fd, POLLIN, 0}, {wake[0], POLLIN, 0}};
+        ssize_t n;
+        do {
+            n = poll(fds, 2, -1);
+            if(n > 0 and fds[1].revents) return;
+            if(n > 0) n = read(fd, slot->data.data(), slot->data.size());
+        } while(n < 0 and errno == EINTR);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            slot->size = n > 0 ? n : 0;
+            if(n > 0) ++filled;
+            else done = true; // end of input or error
+        }
+        cond.notify_all();
+        if(n <= 0) return;
+    }
+}
+
+size_t ReadAheadSource::next_chunk(const byte *&chunk) {
+    std::unique_lock<std::mutex> guard(lock);
+    if(consumed > released) {
+        // the previous chunk is no longer referenced
+        ++released;
+        cond.notify_all();
+    }
+    if(consumed == filled and !done) {
+        ++stats.stalls;
+        auto start = std::chrono::steady_clock::now();
+        cond.wait(guard, [this] { return consumed < filled or done; });
+        std::chrono::duration<double> waited =
+            std::chrono::steady_clock::now() - start;
+        stats.stall_seconds += waited.count();
+    }
+    if(consumed == filled) return 0;
+    Slot &slot = slots[consumed++ % slots.size()];
+    ++stats.chunks;
+    chunk = slot.data.data();
+    return slot.size;
+}
+
+ReadAheadStats ReadAheadSource::get_stats() {
+    std::lock_guard<std::mutex> guard(lock);
+    return stats;
+}
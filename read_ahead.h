@@ -0,0 +1,43 @@
+#ifndef _READ_AHEAD_H_
+#define _READ_AHEAD_H_
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "input_source.h"
+struct ReadAheadStats {
+    uint64_t chunks;      // handed to the bit reader
+    uint64_t stalls;      // times the bit reader waited for I/O
+    double stall_seconds; // total time spent waiting
+};
+
+/* a background thread reads from a descriptor into `depth` buffers of
+ * chunk_size bytes, handing over each buffer as soon as a read returns
+ * data; the bit reader only blocks when it catches up */
+class ReadAheadSource : public InputSource {
+private:
+    struct Slot {
+        std::vector<byte> data;
+        size_t size;
+    };
+    const int fd;
+    int wake[2]; // pipe that interrupts a blocked read on shutdown
+    std::vector<Slot> slots;
+    uint64_t filled;   // slots filled by the reader thread
+    uint64_t consumed; // slots handed out
+    uint64_t released; // slots given back
+    bool done, stop;
+    ReadAheadStats stats;
+
+    std::mutex lock;
+    std::condition_variable cond;
+    std::thread reader;
+    void run();
+public:
+    ReadAheadSource(int __fd, int depth=3, size_t chunk_size=1<<20);
+    ~ReadAheadSource();
+    size_t next_chunk(const byte *&chunk);
+    ReadAheadStats get_stats();
+};
+#endif
@@ -0,0 +1,145 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "stream_index.h"
+
+struct IndexHeader {
+    char magic[4];
+    uint32_t count;
+    uint64_t source_size;
+    int64_t source_sec, source_nsec; // mtime
+};
+const char index_magic[4] = {'M', '1', 'V', '2'};
+
+/* record every sequence header, gop and picture start code;
+ * only their headers are parsed, everything else is scanned over */
+void build_index(BitReader &stream, std::vector<IndexEntry> &entries) {
+    uint32_t time_code = 0;
+    stream.next_start_code();
+    while(!stream.eof()) {
+        IndexEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.offset = stream.tell();
+        uint32_t code = stream.read(32);
+        entry.code = code & 0xFF;
+        if(code == sequence_header_code) {
+            entries.push_back(entry);
+        }
+        else if(code == group_start_code) {
+            time_code = stream.read(25);
+            entry.time_code = time_code;
+            entry.info = stream.read(); // closed_gop
+            entries.push_back(entry);
+        }
+        else if(code == picture_start_code) {
+            entry.time_code = time_code;
+            entry.tmp_ref = stream.read(10);
+            entry.info = stream.read(3); // coding_type
+            entries.push_back(entry);
+        }
+        stream.next_start_code();
+    }
+}
+
+void write_index(const char *filename, const char *source,
+        const std::vector<IndexEntry> &entries) {
+    struct stat st;
+    int stat_result = stat(source, &st);
+    assert(stat_result == 0);
+    FILE *file = fopen(filename, "wb");
+    assert(file != nullptr);
+    IndexHeader header;
+    memcpy(header.magic, index_magic, 4);
+    header.count = entries.size();
+    header.source_size = st.st_size;
+    header.source_sec = st.st_mtim.tv_sec;
+    header.source_nsec = st.st_mtim.tv_nsec;
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(entries.data(), sizeof(IndexEntry), entries.size(), file);
+    fclose(file);
+}
+
+StreamIndex::StreamIndex(const char *filename, const char *source, const MappedSource &data) {
+    map = nullptr;
+    if(load(filename, source, data.length())) return;
+    MemorySource input(data.data(), data.length());
+    BitReader stream(input);
+    build_index(stream, scanned);
+    entries = scanned.data();
+    count = scanned.size();
+}
+
+/* map the sidecar if it belongs to source as it is now, length bytes
+ * long, and every offset lies inside it in increasing order */
+bool StreamIndex::load(const char *filename, const char *source, size_t length) {
+    struct stat st, source_st;
+    if(stat(source, &source_st) != 0) return false;
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) return false;
+    fstat(fd, &st);
+    map_size = st.st_size;
+    if(map_size < sizeof(IndexHeader)) {
+        close(fd);
+        return false;
+    }
+    map = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        map = nullptr;
+        return false;
+    }
+
+    const IndexHeader *header = (const IndexHeader*)map;
+    count = header->count;
+    entries = (const IndexEntry*)(header+1);
+    bool valid = memcmp(header->magic, index_magic, 4) == 0
+        and map_size == sizeof(IndexHeader) + count*sizeof(IndexEntry)
+        and header->source_size == (uint64_t)source_st.st_size
+        and header->source_sec == source_st.st_mtim.tv_sec
+        and header->source_nsec == source_st.st_mtim.tv_nsec
+        and header->source_size == length;
+    for(size_t i=0; valid and i<count; ++i)
+        valid = entries[i].offset < length
+            and (i == 0 or entries[i-1].offset < entries[i].offset);
+    if(!valid) {
+        munmap(map, map_size);
+        map = nullptr;
+    }
+    return valid;
+}
+
+StreamIndex::~StreamIndex() {
+    if(map) munmap(map, map_size);
+}
+
+/* find the sequence header and gop to start decoding from for the
+ * given picture, counted in coding order from 0: the latest gop before
+ * it that opens with an I picture */
+bool StreamIndex::seek_point(int picture, size_t &seq, size_t &gop) const {
+    size_t last_seq = 0, last_gop = 0;
+    bool has_seq = false, gop_start = false, found = false;
+    for(size_t i=0; i<count; ++i) {
+        if(entries[i].code == (sequence_header_code & 0xFF)) {
+            last_seq = i;
+            has_seq = true;
+        }
+        else if(entries[i].code == (group_start_code & 0xFF)) {
+            last_gop = i;
+            gop_start = true;
+        }
+        else {
+            if(gop_start and has_seq and entries[i].info == 1) {
+                seq = last_seq;
+                gop = last_gop;
+                found = true;
+            }
+            gop_start = false;
+            if(picture-- == 0) return found;
+        }
+    }
+    return false;
+}
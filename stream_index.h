@@ -0,0 +1,40 @@
+#ifndef _STREAM_INDEX_H_
+#define _STREAM_INDEX_H_
+#include <cstdint>
+#include <vector>
+#include "bit_reader.h"
+#include "input_source.h"
+/* one sequence header, gop or picture, stored as is in the sidecar */
+struct IndexEntry {
+    uint64_t offset;    // of the start code
+    uint32_t time_code; // gop, and pictures of that gop
+    uint16_t tmp_ref;   // picture
+    byte code;          // last byte of the start code
+    byte info;          // gop: closed_gop, picture: coding_type
+};
+
+void build_index(BitReader &stream, std::vector<IndexEntry> &entries);
+/* the sidecar records the size and mtime of source */
+void write_index(const char *filename, const char *source,
+    const std::vector<IndexEntry> &entries);
+
+/* mmap view of a sidecar written by write_index. A sidecar that is
+ * missing, damaged or written for another version of the source is not
+ * used; the mapped source is scanned instead. */
+class StreamIndex {
+private:
+    void *map;
+    size_t map_size;
+    std::vector<IndexEntry> scanned;
+    const IndexEntry *entries;
+    size_t count;
+    bool load(const char *filename, const char *source, size_t length);
+public:
+    StreamIndex(const char *filename, const char *source, const MappedSource &data);
+    ~StreamIndex();
+    bool rescanned() const { return map == nullptr; }
+    size_t size() const { return count; }
+    const IndexEntry &operator[](size_t i) const { return entries[i]; }
+    bool seek_point(int picture, size_t &seq, size_t &gop) const;
+};
+#endif
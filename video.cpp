@@ -1,25 +1,38 @@
 #include <cstdio>
-#include <cmath>
 #include <cstring>
 #include <cassert>
 #include <algorithm>
 #include "magic_code.h"
 #include "bit_reader.h"
 #include "video.h"
+#include "idct.h"
+#include "mc.h"
 
-#define EAT(X) assert(stream.next_bits(X, false));
+#define EAT(N, X) assert(stream.peek(N) == (X)), stream.skip(N);
 #define LOG(MSG) puts(MSG);
 
-const char start_code[]           = "000000000000000000000001";
-const char picture_start_code[]   = "00000000000000000000000100000000";
-const char user_data_start_code[] = "00000000000000000000000110110010";
-const char sequence_header_code[] = "00000000000000000000000110110011";
-const char sequence_error_code[]  = "00000000000000000000000110110100";
-const char extension_start_code[] = "00000000000000000000000110110101";
-const char sequence_end_code[]    = "00000000000000000000000110110111";
-const char group_start_code[]     = "00000000000000000000000110111000";
-const char macroblock_stuffing[]  = "00000001111";
-const char macroblock_escape[]    = "00000001000";
+const uint32_t start_code           = 0x000001;   // 24 bits
+const uint32_t picture_start_code   = 0x00000100; // 32 bits
+const uint32_t user_data_start_code = 0x000001B2;
+const uint32_t sequence_header_code = 0x000001B3;
+const uint32_t sequence_error_code  = 0x000001B4;
+const uint32_t extension_start_code = 0x000001B5;
+const uint32_t sequence_end_code    = 0x000001B7;
+const uint32_t group_start_code     = 0x000001B8;
+const uint32_t macroblock_stuffing  = 0x00F;      // 11 bits
+const uint32_t macroblock_escape    = 0x008;      // 11 bits
+
+/* skip over extension data and user data, both unused */
+inline void skip_extension_and_user_data(BitReader &stream) {
+    if(stream.peek(32) == extension_start_code) {
+        EAT(32, extension_start_code);
+        stream.next_start_code(); // sequence_extension_data
+    }
+    if(stream.peek(32) == user_data_start_code) {
+        EAT(32, user_data_start_code);
+        stream.next_start_code(); // user_data
+    }
+}
 
 /* parse sequance layer */
 void VideoDecoder::video_sequence(BitReader &stream) {
@@ -29,104 +42,95 @@ void VideoDecoder::video_sequence(BitReader &stream) {
         sequence_header(stream);
         do {
             group_of_pictures(stream);
-        } while(stream.next_bits(group_start_code));
-    } while(stream.next_bits(sequence_header_code));
-    display(b_buf); // last backward frame
-    EAT(sequence_end_code);
+        } while(stream.peek(32) == group_start_code);
+    } while(stream.peek(32) == sequence_header_code);
+    if(b_buf) sink.frame(b_buf); // last backward frame
+    if(f_buf) f_buf->release();
+    if(b_buf) b_buf->release();
+    f_buf = b_buf = nullptr;
+    EAT(32, sequence_end_code);
 }
 
 /* parse sequance header */
 void VideoDecoder::sequence_header(BitReader &stream) {
     LOG("sequence header");
-    EAT(sequence_header_code);
+    EAT(32, sequence_header_code);
     h_size = stream.read(12);
     v_size = stream.read(12);
     mb_width = (h_size+15)/16; // /16 & ceil
+    mb_height = (v_size+15)/16;
+    // frames cover whole macroblocks
+    pool.set_size(mb_width*16, mb_height*16);
     per_ratio = stream.read(4);
     picture_rate = stream.read(4);
     bit_rate = stream.read(18);
-    EAT("1"); //marker bit
+    EAT(1, 1); //marker bit
     vbv_buffer_size = stream.read(10);
     const_param_flag = stream.read();
     bool load_intra_quantizer_matrix = stream.read();
+    byte matrix[64];
+    bool matrix_changed = false;
     // check flag bit
     if(load_intra_quantizer_matrix) {
-        stream.read(intra_quant_matrix, 64);
+        stream.read(matrix, 64);
+        if(memcmp(matrix, intra_quant_matrix, 64) != 0) {
+            memcpy(intra_quant_matrix, matrix, 64);
+            matrix_changed = true;
+        }
     }
     bool load_non_intra_quantizer_matrix = stream.read();
     // check flag bit
     if(load_non_intra_quantizer_matrix) {
-        stream.read(non_intra_quant_matrix, 64);
+        stream.read(matrix, 64);
+        if(memcmp(matrix, non_intra_quant_matrix, 64) != 0) {
+            memcpy(non_intra_quant_matrix, matrix, 64);
+            matrix_changed = true;
+        }
     }
+    if(matrix_changed)
+        build_quant_tables();
     // align byte
     stream.next_start_code();
-    if(stream.next_bits(extension_start_code)) {
-        EAT(extension_start_code);
-        while (!stream.next_bits(start_code)) {
-            stream.read(8); // sequence_extension_data
-        }
-        stream.next_start_code();
-    }
-    if(stream.next_bits(user_data_start_code)) {
-        EAT(user_data_start_code);
-        while (!stream.next_bits(start_code)) {
-            stream.read(8); // user_data
-        }
-        stream.next_start_code();
-    }
+    skip_extension_and_user_data(stream);
 }
 
 /* parse gop layer */
 void VideoDecoder::group_of_pictures(BitReader &stream) {
     LOG("group of pictures");
-    EAT(group_start_code);
-    int time_code = stream.read(25);
-    bool closed_gop = stream.read();
+    EAT(32, group_start_code);
+    stream.skip(26); // time_code, closed_gop; the indexer reads these
     bool broken_link = stream.read();
     assert(!broken_link);
     stream.next_start_code();
-    if(stream.next_bits(extension_start_code)) {
-        EAT(extension_start_code);
-        while (!stream.next_bits(start_code)) {
-            stream.read(8); // sequence_extension_data
-        }
-        stream.next_start_code();
-    }
-    if(stream.next_bits(user_data_start_code)) {
-        EAT(user_data_start_code);
-        while (!stream.next_bits(start_code)) {
-            stream.read(8); // user_data
-        }
-        stream.next_start_code();
-    }
+    skip_extension_and_user_data(stream);
     do {
         picture(stream);
-    } while(stream.next_bits(picture_start_code));
+    } while(stream.peek(32) == picture_start_code);
 }
 
 /* check if the following bits are slice start code */
 inline bool is_slice_start_code(BitReader &stream) {
-    stream.save();
-    if(!stream.next_bits(start_code, false)) {
-        stream.restore();
+    uint32_t code = stream.peek(32);
+    if((code >> 8) != start_code)
         return false;
-    }
-    byte code = stream.read(8);
-    stream.restore();
+    code &= 0xFF;
     return 0x01 <= code and code <= 0xAF;
 }
 
 /* parse picture layer */
 void VideoDecoder::picture(BitReader &stream) {
     LOG("picture");
-    EAT(picture_start_code);
+    EAT(32, picture_start_code);
     tmp_ref = stream.read(10);
     coding_type = stream.read(3);
 
-    /* 3-Frame Buffers Algorithm - before decode*/
+    /* reference frames - before decode*/
     if(coding_type <= 2) {
-        std::swap(f_buf, b_buf);
-        display(f_buf);
+        // the newer reference becomes the older one and is due for display
+        if(f_buf) f_buf->release();
+        f_buf = b_buf;
+        b_buf = nullptr;
+        if(f_buf) sink.frame(f_buf);
     }
 
     vbv_delay = stream.read(16);
@@ -146,51 +150,53 @@ void VideoDecoder::picture(BitReader &stream) {
         backward_r_size = backward_f_code - 1;
         backward_f = 1 << backward_r_size;
     }
-    while(stream.next_bits("1")) {
-        EAT("1"); // extra_bit_picture
+    while(stream.peek(1)) {
+        EAT(1, 1); // extra_bit_picture
         stream.read(8); // extra_info_picture
     }
-    EAT("0"); // extra_bit_picture
+    EAT(1, 0); // extra_bit_picture
 
     stream.next_start_code();
-    if(stream.next_bits(extension_start_code)) {
-        EAT(extension_start_code);
-        while (!stream.next_bits(start_code)) {
-            stream.read(8); // sequence_extension_data
-        }
-        stream.next_start_code();
-    }
-    if(stream.next_bits(user_data_start_code)) {
-        EAT(user_data_start_code);
-        while (!stream.next_bits(start_code)) {
-            stream.read(8); // user_data
+    skip_extension_and_user_data(stream);
+    if(coding_type != 1 and !f_buf) {
+        // nothing to predict from, as when decoding starts at a p
+        // picture, or at the b pictures of an open gop; drop it
+        while(is_slice_start_code(stream)) {
+            stream.skip(32);
+            stream.next_start_code();
         }
-        stream.next_start_code();
+        return;
     }
+    c_buf = pool.acquire();
+    c_buf->h_size = h_size;
+    c_buf->v_size = v_size;
     do {
         slice(stream);
     } while(is_slice_start_code(stream));
 
-    /* 3-Frame Buffers Algorithm - after decode*/
+    /* reference frames - after decode*/
     if(coding_type <= 2) {
-        std::swap(c_buf, b_buf);
+        c_buf->extend_edges(); // reference for the following pictures
+        b_buf = c_buf;
     }
     else {
-        display(c_buf);
+        sink.frame(c_buf);
+        c_buf->release();
     }
+    c_buf = nullptr;
 }
 
 /* parse slice layer */
 void VideoDecoder::slice(BitReader &stream) {
     LOG("slice");
-    EAT(start_code);
+    EAT(24, start_code);
     slice_vert_pos = stream.read(8);
     quant_scale = stream.read(5);
-    while(stream.next_bits("1")) {
-        EAT("1"); // extra_bit_slice
+    while(stream.peek(1)) {
+        EAT(1, 1); // extra_bit_slice
         stream.read(8); // extra_info_slice 
     }
-    EAT("0"); // extra_bit_slice
+    EAT(1, 0); // extra_bit_slice
 
     /* reset previous variables */
     past_intra_addr = -2;
@@ -201,7 +207,7 @@ void VideoDecoder::slice(BitReader &stream) {
 
     do {
         macroblock(stream);
-    } while(!stream.next_bits("00000000000000000000000"));
+    } while(stream.peek(23) != 0);
     stream.next_start_code();
 }
 
@@ -238,19 +244,19 @@ inline int calc_recon_motion(int f, int motion_code,
 /* parse macroblock layer */
 void VideoDecoder::macroblock(BitReader &stream) {
     //LOG("macroblock");
-    while(stream.next_bits(macroblock_stuffing))
-        EAT(macroblock_stuffing);
+    while(stream.peek(11) == macroblock_stuffing)
+        EAT(11, macroblock_stuffing);
     int macroblock_addr_increment = 0;
-    while(stream.next_bits(macroblock_escape)) {
+    while(stream.peek(11) == macroblock_escape) {
         // add 33 when meet escape code
-        EAT(macroblock_escape);
+        EAT(11, macroblock_escape);
         macroblock_addr_increment += 33;
     }
     macroblock_addr_increment += ht_macroblock_addr.decode(stream);
 
     /* handle skipped macroblock */
-    for(int i=1; i<macroblock_addr_increment; ++i)
-        write_skipped_macroblock(macroblock_addr+i);
+    if(macroblock_addr_increment > 1)
+        write_skipped_macroblocks(macroblock_addr+1, macroblock_addr_increment-1);
 
     // update macroblcok_addr
     macroblock_addr += macroblock_addr_increment;
@@ -273,8 +279,8 @@ void VideoDecoder::macroblock(BitReader &stream) {
 
     // check motion forward field flag
     if(macroblock_type & mask_macroblock_motion_f) {
-        int motion_h_f_code, motion_h_f_r;
-        int motion_v_f_code, motion_v_f_r;
+        int motion_h_f_code, motion_h_f_r = 0;
+        int motion_v_f_code, motion_v_f_r = 0;
 
         motion_h_f_code = ht_motion_vector.decode(stream);
         if((forward_f != 1) and
@@ -303,8 +309,8 @@ void VideoDecoder::macroblock(BitReader &stream) {
 
     // check motion backward field flag
     if(macroblock_type & mask_macroblock_motion_b) {
-        int motion_h_b_code, motion_h_b_r;
-        int motion_v_b_code, motion_v_b_r;
+        int motion_h_b_code, motion_h_b_r = 0;
+        int motion_v_b_code, motion_v_b_r = 0;
 
         motion_h_b_code = ht_motion_vector.decode(stream);
         if((backward_f != 1) and
@@ -320,7 +326,7 @@ void VideoDecoder::macroblock(BitReader &stream) {
             calc_recon_motion(backward_f, motion_h_b_code, motion_h_b_r,
                 recon_right_back_prev, full_pel_backward_vector);
 
-        recon_down_for =
+        recon_down_back =
             calc_recon_motion(backward_f, motion_v_b_code, motion_v_b_r,
                 recon_down_back_prev, full_pel_backward_vector);
     }
@@ -337,17 +343,16 @@ void VideoDecoder::macroblock(BitReader &stream) {
         cbp = (1<<6) - 1;
     }
 
+    // the prediction goes straight into the frame, coded blocks add
+    // their residual to it; intra blocks store theirs
+    if(!(macroblock_type & mask_macroblock_intra))
+        predict_macroblock(macroblock_addr);
     for(int i=0; i<6; ++i) {
         if(cbp & (1<<(5-i))) {
             block(i, stream);
-            recon_idct(i);
-        } else {
-            for(int j=0; j<8; ++j) for(int k=0; k<8; ++k) block_buf[j][k] = 0;
-        }
-        if(!(macroblock_type & mask_macroblock_intra)) {
-            add_motion_vector(i);
+            recon_idct();
+            write_block(i, macroblock_addr);
         }
-        write_block(i, macroblock_addr);
     }
 
     // update past_intra_addr
@@ -355,332 +360,234 @@ void VideoDecoder::macroblock(BitReader &stream) {
         past_intra_addr = macroblock_addr;
 
     if(coding_type == 4)
-        EAT("1");
+        EAT(1, 1);
     return;
 }
 
-void VideoDecoder::block(int index, BitReader &stream) {
-    //LOG("block");
-    memset(dct_zz, 0, sizeof(dct_zz));
-    int i=0;
-    if(macroblock_type & mask_macroblock_intra) {
-        // intra block
-        int size = 0;
-        if(index<4) {
-            size = ht_dct_dc_size_luminance.decode(stream);
+/* decode one run/level symbol with its sign, false at end of block */
+inline bool decode_run_level(BitReader &stream, const VLCTable &table,
+        int &run, int &level) {
+    int sym = table.decode(stream);
+    if(sym == coef_eob)
+        return false;
+    if(sym == coef_escape) { // fixed length
+        run = stream.read(6);
+        int tmp = stream.read(8);
+        if(tmp == 0x00) { // >=128
+            level = stream.read(8);
         }
-        else {
-            size = ht_dct_dc_size_chrominance.decode(stream);
+        else if(tmp == 0x80) { // <= -128
+            level = stream.read(8)-256;
         }
-        if(size == 0) {
-            dct_zz[0] = 0;
-        }
-        else {
-            int dct_dc_diff = stream.read(size);
-            if(dct_dc_diff & (1<<(size-1))) dct_zz[0] = dct_dc_diff;
-            else dct_zz[0] = (-1 << size) | (dct_dc_diff+1);
+        else { // otherwise
+            level = (signed char)tmp;
         }
     }
     else {
-        // non-intra block
-        int run, level;
-        std::tie(run, level) = decode_run_level(stream, true);
-        i = run;
-        dct_zz[i] = level;
-    }
-    if(coding_type != 4) {
-        // ac coefs
-        while(!stream.next_bits("10")) {
-            int run, level;
-            std::tie(run, level) = decode_run_level(stream);
-            i = i+run+1;
-            assert(i < 64);
-            dct_zz[i] = level;
-        }
-        EAT("10");
+        run = sym >> 8;
+        level = (signed char)sym;
     }
-};
-
-inline void idct(double res[8], double mat[8]) {
-    double c2 = 2*cos(M_PI/8);
-    double c4 = 2*cos(2*M_PI/8);
-    double c6 = 2*cos(3*M_PI/8);
-    double sq8 = sqrt(8);
-
-    // B1
-    double a0 = (1./8*mat[0])*sq8;
-    double a1 = (1./8*mat[4])*sq8;
-    double a2 = (1./8*mat[2] - 1./8*mat[6])*sq8;
-    double a3 = (1./8*mat[2] + 1./8*mat[6])*sq8;
-    double a4 = (1./8*mat[5] - 1./8*mat[3])*sq8;
-    double temp1 = (1./8*mat[1] + 1./8*mat[7])*sq8;
-    double temp2 = (1./8*mat[3] + 1./8*mat[5])*sq8;
-    double a5 = temp1 - temp2;
-    double a6 = (1./8*mat[1] - 1./8*mat[7])*sq8;
-    double a7 = temp1+temp2;
-
-    // M
-    double b0 = a0;
-    double b1 = a1;
-    double b2 = a2*c4;
-    double b3 = a3;
-    double Q = c2-c6, R = c2+c6, temp4 = c6*(a4+a6);
-    double b4 = -Q*a4 - temp4;
-    double b5 = a5*c4;
-    double b6 = R*a6 - temp4;
-    double b7 = a7;
-
-    // A1
-    double temp3 = b6 - b7;
-    double n0 = temp3 - b5;
-    double n1 = b0 - b1;
-    double n2 = b2 - b3;
-    double n3 = b0 + b1;
-    double n4 = temp3;
-    double n5 = b4;
-    double n6 = b3;
-    double n7 = b7;
-
-    // A2
-    double m0 = n7;
-    double m1 = n0;
-    double m2 = n4;
-    double m3 = n1 + n2;
-    double m4 = n3 + n6;
-    double m5 = n1 - n2;
-    double m6 = n3 - n6;
-    double m7 = n5 - n0;
-
-    // A3
-    res[0] = m4 + m0;
-    res[1] = m3 + m2;
-    res[2] = m5 - m1;
-    res[3] = m6 - m7;
-    res[4] = m6 + m7;
-    res[5] = m5 + m1;
-    res[6] = m3 - m2;
-    res[7] = m4 - m0;
-    return;
+    return true;
 }
 
-inline void transpose(double mat[8][8]) {
-    for(int i=0; i<7; ++i)
-        for(int j=i+1; j<8; ++j)
-            std::swap(mat[i][j], mat[j][i]);
-    return;
+#define SIGN(x) ((x > 0) - (x < 0))
+
+/* dequantise a level, scale being quant_scale times the matrix entry */
+inline int dequant(int level, int scale, bool intra) {
+    int tmp;
+    if(intra)
+        tmp = (2*level*scale)/16;
+    else
+        tmp = (((2*level)+SIGN(level))*scale)/16;
+    // oddification
+    if((tmp & 1) == 0)
+        tmp = tmp - SIGN(tmp);
+    if(tmp > 2047) tmp = 2047;
+    if(tmp < -2048) tmp = -2048;
+    return tmp;
 }
 
-inline void idct2d(double mat[8][8]) {
-    double row[8][8];
-    memcpy(row, mat, sizeof(row));
-    for(int i=0; i<8; ++i)
-        idct(row[i], mat[i]);
-    transpose(row);
-    for(int i=0; i<8; ++i)
-        idct(mat[i], row[i]);
-    transpose(mat);
-    return;
+/* dequantise the coefficient of zigzag index i into natural order */
+inline void VideoDecoder::set_coef(int i, int level) {
+    int pos = scan_pos[i];
+    if(macroblock_type & mask_macroblock_intra)
+        dct_coef[pos] = dequant(level, intra_quant_table[quant_scale][i], true);
+    else
+        dct_coef[pos] = dequant(level, non_intra_quant_table[quant_scale][i], false);
+    coef_pos[coef_count++] = pos;
 }
 
-void VideoDecoder::recon_idct(int index) {
-    #define SIGN(x) ((x > 0) - (x < 0))
-    // recontruct dct ac component
-    for(int m=0; m<8; ++m) {
-        for(int n=0; n<8; ++n) {
-            int i = scan[m][n];
-            int tmp;
-            if(macroblock_type & mask_macroblock_intra)
-                tmp =
-                    (2*dct_zz[i]*quant_scale*intra_quant_matrix[i])/16;
-            else
-                tmp = (((2*dct_zz[i])+SIGN(dct_zz[i]))*
-                    quant_scale*non_intra_quant_matrix[i])/16;
-            if((tmp & 1) == 0)
-                tmp = tmp - SIGN(tmp);
-            if(tmp > 2047) tmp = 2047;
-            if(tmp < -2048) tmp = -2048;
-            if(dct_zz[i] == 0) tmp = 0;
-            block_buf[m][n] = tmp;
+void VideoDecoder::block(int index, BitReader &stream) {
+    //LOG("block");
+    coef_count = 0;
+    int i=0, run=0, level=0;
+    if(macroblock_type & mask_macroblock_intra) {
+        // intra block
+        int size = 0;
+        if(index<4) {
+            size = ht_dct_dc_size_luminance.decode(stream);
+        }
+        else {
+            size = ht_dct_dc_size_chrominance.decode(stream);
+        }
+        int dct_dc_diff = 0;
+        if(size != 0) {
+            dct_dc_diff = stream.read(size);
+            if(!(dct_dc_diff & (1<<(size-1))))
+                dct_dc_diff = (-1 << size) | (dct_dc_diff+1);
         }
-    }
 
-    if(macroblock_type & mask_macroblock_intra) {
         // reconstruct dct dc component
-        double *dct_dc_past;
+        int *dct_dc_past;
         if(index < 4) dct_dc_past = &dct_dc_y_past;
         else if(index == 4) dct_dc_past = &dct_dc_cb_past;
         else dct_dc_past = &dct_dc_cr_past;
 
-        block_buf[0][0] = dct_zz[0]*8;
+        int dc = dct_dc_diff*8;
         if((index == 0 || index > 3) &&
             macroblock_addr-past_intra_addr > 1) {
             // first block
-            block_buf[0][0] = 128*8 + block_buf[0][0];
+            dc = 128*8 + dc;
         }
         else {
             // not first block
-            block_buf[0][0] = *dct_dc_past + block_buf[0][0];
+            dc = *dct_dc_past + dc;
         }
-        *dct_dc_past = block_buf[0][0];
-    }
-    idct2d(block_buf);
-}
-
-template<int W>
-inline void add_pel_past(double pel[8][8], double pel_past[][W],
-        int recon_right, int recon_down,
-        int index, bool half,
-        int macroblock_addr, int mb_width) {
-        int right, down, right_half, down_half;
-    if(index < 4) {
-        right = recon_right >> 1;
-        down = recon_down >> 1;
-        right_half = recon_right - 2*right ;
-        down_half = recon_down - 2*down;
-    } else {
-        right = (recon_right/2) >> 1;
-        down = (recon_down/2) >> 1;
-        right_half = recon_right/2 - 2*right;
-        down_half = recon_down/2 - 2*down;
-    }
-    
-    double weight = half?0.5:1;
-
-    int mb_row = macroblock_addr/mb_width;
-    int mb_col = macroblock_addr%mb_width;
-    int top = mb_row*16;
-    int left = mb_col*16;
-    switch(index) {
-        case 0: break;
-        case 1: left+=8; break;
-        case 2: top+=8; break;
-        case 3: left+=8, top+=8; break;
-        default: top /= 2, left /= 2;
+        *dct_dc_past = dc;
+        dct_coef[0] = dc;
+        coef_pos[coef_count++] = 0;
     }
-    if(!right_half && !down_half) {
-        for(int i=0; i<8; ++i)
-            for(int j=0; j<8; ++j) {
-                pel[i][j] +=
-                    pel_past[top+i+down][left+j+right]*weight;
-            }
-    } else if(!right_half && down_half) {
-        for(int i=0; i<8; ++i)
-            for(int j=0; j<8; ++j) {
-                pel[i][j] +=
-                    (pel_past[top+i+down][left+j+right] +
-                    pel_past[top+i+down+1][left+j+right])/2*weight;
-            }
-    } else if(right_half && !down_half) {
-        for(int i=0; i<8; ++i)
-            for(int j=0; j<8; ++j) {
-                pel[i][j] +=
-                    (pel_past[top+i+down][left+j+right] +
-                    pel_past[top+i+down][left+j+right+1])/2*weight;
+    else {
+        // non-intra block, the first coefficient cannot end the block
+        bool coded = decode_run_level(stream, ht_coef_first, run, level);
+        assert(coded); // ht_coef_first has no eob
+        i = run;
+        set_coef(i, level);
+    }
+    if(coding_type != 4 and coef_multi) {
+        // ac coefs, up to three short codes per lookup
+        for(;;) {
+            const RunLevelEntry &e = ht_coef_multi[stream.peek(coef_multi_bits)];
+            if(e.len == 0) {
+                if(!decode_run_level(stream, ht_coef_next, run, level))
+                    break;
+                i = i+run+1;
+                assert(i < 64);
+                set_coef(i, level);
+                continue;
             }
-    } else if(right_half && down_half) {
-        for(int i=0; i<8; ++i)
-            for(int j=0; j<8; ++j) {
-                pel[i][j] +=
-                    (pel_past[top+i+down][left+j+right] +
-                    pel_past[top+i+down][left+j+right+1] +
-                    pel_past[top+i+down+1][left+j+right] +
-                    pel_past[top+i+down+1][left+j+right+1])/4*weight;
+            stream.skip(e.len);
+            for(int k=0; k<e.n; ++k) {
+                i = i+e.run[k]+1;
+                assert(i < 64);
+                set_coef(i, e.level[k]);
             }
+            if(e.eob) break;
+        }
     }
+    else if(coding_type != 4) {
+        // ac coefs
+        while(decode_run_level(stream, ht_coef_next, run, level)) {
+            i = i+run+1;
+            assert(i < 64);
+            set_coef(i, level);
+        }
+    }
+    coef_last = i;
+};
+
+void VideoDecoder::recon_idct() {
+    int16_t *blk = block_buf;
+    memcpy(blk, dct_coef, sizeof(block_buf));
+    // leave dct_coef all zero for the next block
+    for(int k=0; k<coef_count; ++k)
+        dct_coef[coef_pos[k]] = 0;
+
+    // zigzag indices below 10 all lie in the top left 4x4
+    if(coef_last == 0) idct2d_dc(blk);
+    else if(coef_last < 10) idct2d_4x4(blk);
+    else idct2d(blk);
 }
 
-void VideoDecoder::write_skipped_macroblock(int address) {
+/* count skipped macroblocks from first on */
+void VideoDecoder::write_skipped_macroblocks(int first, int count) {
     if(coding_type == 2) {
         recon_right_for = recon_down_for = 0;
         recon_right_back = recon_down_back = 0;
         recon_right_for_prev = recon_down_for_prev = 0;
         recon_right_back_prev = recon_down_back_prev = 0;
-    }
 
-    bool has_f = coding_type == 2 || (macroblock_type & mask_macroblock_motion_f);
-    bool has_b = macroblock_type & mask_macroblock_motion_b;
-    bool half = has_f && has_b;
-
-    for(int y=0; y<4; ++y) {
-        for(int i=0; i<8; ++i) for(int j=0; j<8; ++j) block_buf[i][j] = 0;
-        if(has_f)
-            add_pel_past(block_buf, f_buf->y,
-                recon_right_for, recon_down_for, y, half,
-                address, mb_width);
-        if(has_b)
-            add_pel_past(block_buf, b_buf->y,
-                recon_right_back, recon_down_back, y, half,
-                address, mb_width);
-        write_block(y, address);
-    }
-    {
-        for(int i=0; i<8; ++i) for(int j=0; j<8; ++j) block_buf[i][j] = 0;
-        if(has_f)
-            add_pel_past(block_buf, f_buf->cb,
-                recon_right_for, recon_down_for, 4, half,
-                address, mb_width);
-        if(has_b)
-            add_pel_past(block_buf, b_buf->cb,
-                recon_right_back, recon_down_back, 4, half,
-                address, mb_width);
-        write_block(4, address);
+        // plain copies from the forward reference, one row of
+        // macroblocks at a time
+        int y_stride = c_buf->y_stride, c_stride = c_buf->c_stride;
+        for(int addr=first, end=first+count; addr<end; ) {
+            int mb_row = addr/mb_width;
+            int mb_col = addr%mb_width;
+            int n = std::min(end-addr, mb_width-mb_col);
+            int offset = mb_row*16*y_stride + mb_col*16;
+            for(int i=0; i<16; ++i, offset+=y_stride)
+                memcpy(c_buf->y + offset, f_buf->y + offset, n*16);
+            offset = mb_row*8*c_stride + mb_col*8;
+            for(int i=0; i<8; ++i, offset+=c_stride) {
+                memcpy(c_buf->cb + offset, f_buf->cb + offset, n*8);
+                memcpy(c_buf->cr + offset, f_buf->cr + offset, n*8);
+            }
+            addr += n;
+        }
+        return;
     }
-    {
-        for(int i=0; i<8; ++i) for(int j=0; j<8; ++j) block_buf[i][j] = 0;
-        if(has_f)
-            add_pel_past(block_buf, f_buf->cr,
-                recon_right_for, recon_down_for, 5, half,
-                address, mb_width);
-        if(has_b)
-            add_pel_past(block_buf, b_buf->cr,
-                recon_right_back, recon_down_back, 5, half,
-                address, mb_width);
-        write_block(5, address);
+
+    // b pictures keep the vectors and directions of the previous
+    // macroblock, so each row of the run is predicted in one go
+    for(int addr=first, end=first+count; addr<end; ) {
+        int n = std::min(end-addr, mb_width-addr%mb_width);
+        predict_macroblock(addr, n);
+        addr += n;
     }
 }
 
-void VideoDecoder::add_motion_vector(int index) {
+/* prediction of count macroblocks in a row from address on, from ref
+ * into c_buf; avg averages it into the prediction already there */
+void VideoDecoder::predict_from(const YCbCrBuffer *ref,
+        int recon_right, int recon_down, int address, int count, bool avg) {
+    const MCKernel *kernel = avg ? mc->avg : mc->put;
+    int mb_row = address/mb_width;
+    int mb_col = address%mb_width;
+
+    int right = recon_right >> 1;
+    int down = recon_down >> 1;
+    int mode = (recon_right - 2*right) | (recon_down - 2*down) << 1;
+    kernel[mode](c_buf->y + mb_row*16*c_buf->y_stride + mb_col*16, c_buf->y_stride,
+        ref->y + (mb_row*16+down)*ref->y_stride + mb_col*16+right,
+        ref->y_stride, 16*count, 16);
+
+    right = (recon_right/2) >> 1;
+    down = (recon_down/2) >> 1;
+    mode = (recon_right/2 - 2*right) | (recon_down/2 - 2*down) << 1;
+    int dst = mb_row*8*c_buf->c_stride + mb_col*8;
+    int src = (mb_row*8+down)*ref->c_stride + mb_col*8+right;
+    kernel[mode](c_buf->cb + dst, c_buf->c_stride, ref->cb + src, ref->c_stride, 8*count, 8);
+    kernel[mode](c_buf->cr + dst, c_buf->c_stride, ref->cr + src, ref->c_stride, 8*count, 8);
+}
+
+void VideoDecoder::predict_macroblock(int address, int count) {
     bool has_f = coding_type == 2 || (macroblock_type & mask_macroblock_motion_f);
     bool has_b = macroblock_type & mask_macroblock_motion_b;
-    bool half = has_f && has_b;
-    if(has_f) {
-        if(index < 4)
-            add_pel_past(block_buf, f_buf->y,
-                recon_right_for, recon_down_for, index, half,
-                macroblock_addr, mb_width);
-        else if(index == 4)
-            add_pel_past(block_buf, f_buf->cb,
-                recon_right_for, recon_down_for, index, half,
-                macroblock_addr, mb_width);
-        else
-            add_pel_past(block_buf, f_buf->cr,
-                recon_right_for, recon_down_for, index, half,
-                macroblock_addr, mb_width);
-    }
-    if(has_b) {
-        if(index < 4)
-            add_pel_past(block_buf, b_buf->y,
-                recon_right_back, recon_down_back, index, half,
-                macroblock_addr, mb_width);
-        else if(index == 4)
-            add_pel_past(block_buf, b_buf->cb,
-                recon_right_back, recon_down_back, index, half,
-                macroblock_addr, mb_width);
-        else
-            add_pel_past(block_buf, b_buf->cr,
-                recon_right_back, recon_down_back, index, half,
-                macroblock_addr, mb_width);
-    }
+    if(has_f)
+        predict_from(f_buf, recon_right_for, recon_down_for, address, count, false);
+    if(has_b) // bidirectional averages into the forward prediction
+        predict_from(b_buf, recon_right_back, recon_down_back, address, count, has_f);
 }
 
 void VideoDecoder::write_block(int index, int addr) {
     // calculate row, column
     int mb_row = addr/mb_width;
     int mb_col = addr%mb_width;
+    int top, left;
     if(index <=3) {
         // Y
-        int top = mb_row*16;
-        int left = mb_col*16;
+        top = mb_row*16;
+        left = mb_col*16;
         switch(index) {
             case 0: break;
             case 1: left+=8; break;
@@ -688,26 +595,16 @@ void VideoDecoder::write_block(int index, int addr) {
             case 3: left+=8, top+=8; break;
             default: assert(false);
         }
-        for(int i=0; i<8; ++i)
-            for(int j=0; j<8; ++j)
-                c_buf->y[i+top][j+left] =
-                    std::max(0., std::min(255., block_buf[i][j]));
     }
     else {
-        int top = mb_row*8;
-        int left = mb_col*8;
-        if(index == 4) {
-            // Cb
-            for(int i=0; i<8; ++i)
-                for(int j=0; j<8; ++j)
-                    c_buf->cb[i+top][j+left] =
-                        std::max(0., std::min(255., block_buf[i][j]));
-        } else {
-            // Cr
-            for(int i=0; i<8; ++i)
-                for(int j=0; j<8; ++j)
-                    c_buf->cr[i+top][j+left] =
-                        std::max(0., std::min(255., block_buf[i][j]));
-        }
+        // Cb, Cr
+        top = mb_row*8;
+        left = mb_col*8;
     }
+    int stride = c_buf->stride(index);
+    byte *dst = c_buf->plane(index) + top*stride + left;
+    if(macroblock_type & mask_macroblock_intra)
+        mc->put_residual(dst, stride, block_buf);
+    else
+        mc->add_residual(dst, stride, block_buf);
 }
@@ -1,47 +1,42 @@
 #ifndef _VIDEO_H_
 #define _VIDEO_H_
-#include <tuple>
 #include <vector>
 #include "bit_reader.h"
-//class CImgDisplay;
-#include "CImg.h"
-using namespace cimg_library;
+#include "frame_pool.h"
 extern const int scan[8][8];
+extern const byte scan_pos[64];
 extern const byte mask_macroblock_quant;
 extern const byte mask_macroblock_motion_f;
 extern const byte mask_macroblock_motion_b;
 extern const byte mask_macroblock_pattern;
 extern const byte mask_macroblock_intra;
-struct YCbCrBuffer {
-    double y[768][576];
-    double cb[384][288];
-    double cr[384][288];
-};
+extern const VLCTable ht_macroblock_addr;
+extern const VLCTable ht_coded_block_pattern;
+extern const VLCTable ht_motion_vector;
+extern const VLCTable ht_dct_dc_size_luminance;
+extern const VLCTable ht_dct_dc_size_chrominance;
+extern const VLCTable ht_intra_macroblock_type;
+extern const VLCTable ht_p_macroblock_type;
+extern const VLCTable ht_b_macroblock_type;
+extern const VLCTable ht_coef_first;
+extern const VLCTable ht_coef_next;
+extern const RunLevelEntry ht_coef_multi[];
 class VideoDecoder {
 private:
-    /* display */
-    CImgDisplay main_disp;
-
-    /* huffman trees */
-    HuffmanTree ht_macroblock_addr;
-    HuffmanTree ht_coded_block_pattern;
-    HuffmanTree ht_motion_vector;
-    HuffmanTree ht_dct_dc_size_luminance;
-    HuffmanTree ht_dct_dc_size_chrominance;
-    HuffmanTree ht_intra_macroblock_type;
-    HuffmanTree ht_p_macroblock_type;
-    HuffmanTree ht_b_macroblock_type;
-    HuffmanTree ht_run_level_ind;
-    std::vector<int> run_list, level_list;
+    /* output */
+    FrameSink &sink;
 
     /* sequence header */
-    int h_size, v_size, mb_width;
+    int h_size, v_size, mb_width, mb_height;
     byte per_ratio, picture_rate;
     int bit_rate;
     int vbv_buffer_size;
     bool const_param_flag;
     byte *intra_quant_matrix;
     byte *non_intra_quant_matrix;
+    /* quant_scale times the matrices, rebuilt when they change */
+    uint16_t intra_quant_table[32][64];
+    uint16_t non_intra_quant_table[32][64];
 
     /* picture */
     int tmp_ref;
@@ -61,10 +56,17 @@ private:
     /* macroblock */
     byte macroblock_type;
 
+    /* frames */
+    HeapAllocator heap;
+    FramePool pool;
+
     /* buffer */
-    int dct_zz[64];
-    double block_buf[8][8];
-    YCbCrBuffer *b_buf, *c_buf, *f_buf;
+    int16_t dct_coef[64]; // dequantised, natural order, zero between blocks
+    byte coef_pos[64]; // positions set in dct_coef
+    int coef_count;
+    int coef_last; // zigzag index of the last coded coefficient
+    int16_t block_buf[64]; // idct output of the current block
+    YCbCrBuffer *b_buf, *c_buf, *f_buf; // backward, current, forward
 
     /* now */
     int macroblock_addr;
@@ -73,14 +75,19 @@ private:
 
     /* past */
     int past_intra_addr;
-    double dct_dc_y_past, dct_dc_cb_past, dct_dc_cr_past;
+    int dct_dc_y_past, dct_dc_cb_past, dct_dc_cr_past;
     int recon_right_for_prev, recon_down_for_prev;
     int recon_right_back_prev, recon_down_back_prev;
 
-    std::tuple<int, int> decode_run_level(BitReader &stream, bool first=false);
-    
 public:
-    VideoDecoder();
+    /* decode ac coefficients with ht_coef_multi instead of one code at
+     * a time; off by default, as make bench finds no gain */
+    bool coef_multi;
+
+    /* frames go to sink; they come from allocator, or the heap if none
+     * is given */
+    VideoDecoder(FrameSink &__sink, FrameAllocator *allocator=nullptr,
+        size_t frames=8);
     void video_sequence(BitReader &stream);
     void sequence_header(BitReader &stream);
     void group_of_pictures(BitReader &stream);
@@ -88,11 +95,14 @@ public:
     void slice(BitReader &stream);
     void macroblock(BitReader &stream);
     void block(int index, BitReader &stream);
+    void set_coef(int i, int level);
+    void build_quant_tables();
 
-    void write_skipped_macroblock(int address);
-    void add_motion_vector(int index);
-    void recon_idct(int index);
+    void write_skipped_macroblocks(int first, int count);
+    void predict_from(const YCbCrBuffer *ref, int recon_right,
+        int recon_down, int address, int count, bool avg);
+    void predict_macroblock(int address, int count=1);
+    void recon_idct();
     void write_block(int index, int addr);
-    void display(YCbCrBuffer *buf);
 };
 #endif
@@ -0,0 +1,17 @@
+#ifndef _VIDEO_DISPLAY_H_
+#define _VIDEO_DISPLAY_H_
+#include <vector>
+#include "frame_pool.h"
+#include "color.h"
+#include "CImg.h"
+/* shows frames in a window at 40 fps at most; space pauses */
+class DisplaySink : public FrameSink {
+private:
+    cimg_library::CImgDisplay main_disp;
+    ColorConverter converter;
+    std::vector<byte> rgb_buf; // planar rgb of the frame on screen
+public:
+    DisplaySink(ChromaFilter chroma=chroma_bilinear);
+    void frame(YCbCrBuffer *buf);
+};
+#endif